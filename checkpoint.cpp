@@ -0,0 +1,250 @@
+#include "checkpoint.h"
+#include "cutil.h"
+
+#include <QFile>
+#include <QSaveFile>
+#include <QDataStream>
+#include <QByteArray>
+
+#include <algorithm>
+#include <string.h>
+
+
+// Names of the filter types in checkpoints, which stay the same when filters
+// are added or reordered. Existing names must not change.
+static const char *g_filterids[] = {
+    "select",
+    "quadhut_ideal",
+    "quadhut_classic",
+    "quadhut_normal",
+    "quadhut_barely",
+    "quadmonument_95",
+    "quadmonument_90",
+    "biome_1",
+    "biome_4_river",
+    "biome_16_shore",
+    "biome_64_rare",
+    "biome_256_biome",
+    "biome_256_otemp",
+    "temps",
+    "spawn",
+    "stronghold",
+    "desert_pyramid",
+    "jungle_pyramid",
+    "swamp_hut",
+    "igloo",
+    "monument",
+    "village",
+    "outpost",
+    "mansion",
+};
+static_assert(sizeof(g_filterids) / sizeof(*g_filterids) == FILTER_MAX,
+        "every filter type needs a name in checkpoints");
+
+static int str2filter(const QByteArray& id)
+{
+    for (int i = 0; i < FILTER_MAX; i++)
+        if (id == g_filterids[i])
+            return i;
+    return -1;
+}
+
+void writeCondition(QDataStream& out, const Condition& c)
+{
+    const BiomeFilter& bf = c.bfilter;
+
+    out << QByteArray(c.type >= 0 && c.type < FILTER_MAX ? g_filterids[c.type] : "");
+    out << (qint32) c.x1 << (qint32) c.z1 << (qint32) c.x2 << (qint32) c.z2;
+    out << (qint32) c.save << (qint32) c.relative;
+    out << (quint64) bf.tempsToFind << (quint64) bf.otempToFind;
+    out << (quint64) bf.majorToFind << (quint64) bf.edgesToFind;
+    out << (quint64) bf.raresToFind << (quint64) bf.raresToFindM;
+    out << (quint64) bf.shoreToFind << (quint64) bf.shoreToFindM;
+    out << (quint64) bf.riverToFind << (quint64) bf.riverToFindM;
+    out << (quint64) bf.oceanToFind << (qint32) bf.specialCnt;
+    out << (quint64) c.exclb << (quint64) c.exclm;
+    for (int i = 0; i < 9; i++)
+        out << (qint32) c.temps[i];
+    out << (qint32) c.count;
+}
+
+// reads a condition, the filter type of which is -1 if it is unknown
+static void readCondition(QDataStream& in, Condition *c)
+{
+    BiomeFilter& bf = c->bfilter;
+    qint32 i32[7];
+    quint64 u64[13];
+    QByteArray id;
+
+    memset(c, 0, sizeof(*c));
+    in >> id;
+    i32[0] = str2filter(id);
+    for (int i = 1; i < 7; i++)
+        in >> i32[i];
+    c->type = i32[0];
+    c->x1 = i32[1]; c->z1 = i32[2]; c->x2 = i32[3]; c->z2 = i32[4];
+    c->save = i32[5];
+    c->relative = i32[6];
+
+    for (int i = 0; i < 11; i++)
+        in >> u64[i];
+    in >> i32[0];
+    bf.tempsToFind = u64[0];  bf.otempToFind = u64[1];
+    bf.majorToFind = u64[2];  bf.edgesToFind = u64[3];
+    bf.raresToFind = u64[4];  bf.raresToFindM = u64[5];
+    bf.shoreToFind = u64[6];  bf.shoreToFindM = u64[7];
+    bf.riverToFind = u64[8];  bf.riverToFindM = u64[9];
+    bf.oceanToFind = u64[10]; bf.specialCnt = i32[0];
+
+    in >> u64[11] >> u64[12];
+    c->exclb = u64[11];
+    c->exclm = u64[12];
+    for (int i = 0; i < 9; i++)
+    {
+        in >> i32[0];
+        c->temps[i] = i32[0];
+    }
+    in >> i32[0];
+    c->count = i32[0];
+}
+
+// sorted seeds as variable length deltas
+static QByteArray encodeSeeds(QVector<int64_t> seeds)
+{
+    QByteArray ba;
+    uint64_t prev = 0;
+
+    std::sort(seeds.begin(), seeds.end(),
+        [](int64_t a, int64_t b) { return (uint64_t)a < (uint64_t)b; });
+    ba.reserve(seeds.size() * 4);
+    for (int64_t s : seeds)
+    {
+        uint64_t d = (uint64_t)s - prev;
+        prev = (uint64_t)s;
+        while (d >= 0x80)
+        {
+            ba.append((char)(d | 0x80));
+            d >>= 7;
+        }
+        ba.append((char)d);
+    }
+    return qCompress(ba);
+}
+
+static bool decodeSeeds(const QByteArray& data, quint32 cnt, QVector<int64_t> *seeds)
+{
+    QByteArray ba = qUncompress(data);
+    const uchar *p = (const uchar*) ba.constData();
+    const uchar *e = p + ba.size();
+    uint64_t prev = 0;
+
+    // each seed takes at least one byte, which bounds a corrupt count
+    if (cnt > (quint32) ba.size())
+        return false;
+    seeds->reserve(cnt);
+    for (quint32 i = 0; i < cnt; i++)
+    {
+        uint64_t d = 0;
+        int shift = 0;
+        do
+        {
+            if (p == e || shift > 63)
+                return false;
+            d |= (uint64_t)(*p & 0x7f) << shift;
+            shift += 7;
+        }
+        while (*p++ & 0x80);
+        prev += d;
+        seeds->push_back((int64_t)prev);
+    }
+    return p == e;
+}
+
+bool isCheckpointFile(const QString& path)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+    QDataStream in(&file);
+    quint32 magic = 0;
+    in >> magic;
+    return magic == CHECKPOINT_MAGIC;
+}
+
+bool saveCheckpoint(const QString& path, const Checkpoint& cp)
+{
+    const char *mcstr = mc2str(cp.mc);
+    if (!mcstr)
+        return false;
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly))
+        return false;
+
+    QDataStream out(&file);
+    out.setVersion(QDataStream::Qt_5_0);
+    out.setByteOrder(QDataStream::BigEndian);
+
+    out << (quint32) CHECKPOINT_MAGIC << (quint32) CHECKPOINT_VERSION;
+    out << (qint32) cp.searchtype << QByteArray(mcstr);
+    out << (qint64) cp.progress << (qint64) cp.end;
+    out << cp.listpath << (qint64) cp.listpos;
+    out << (quint32) cp.condvec.size();
+    for (const Condition& c : cp.condvec)
+        writeCondition(out, c);
+    out << (quint32) cp.seeds.size() << encodeSeeds(cp.seeds);
+
+    if (out.status() != QDataStream::Ok)
+    {
+        file.cancelWriting();
+        return false;
+    }
+    return file.commit();
+}
+
+bool loadCheckpoint(const QString& path, Checkpoint *cp)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+
+    QDataStream in(&file);
+    in.setVersion(QDataStream::Qt_5_0);
+    in.setByteOrder(QDataStream::BigEndian);
+
+    quint32 magic, version, cnt;
+    qint32 searchtype, mc;
+    qint64 progress, end, listpos;
+    QString listpath;
+    QByteArray mcstr, data;
+
+    in >> magic >> version;
+    if (magic != CHECKPOINT_MAGIC || version > CHECKPOINT_VERSION)
+        return false;
+
+    in >> searchtype >> mcstr >> progress >> end >> listpath >> listpos;
+    if (in.status() != QDataStream::Ok || (mc = str2mc(mcstr.constData())) < 0)
+        return false;
+    cp->listpath = listpath;
+    cp->listpos = listpos;
+    cp->searchtype = searchtype;
+    cp->mc = mc;
+    cp->progress = progress;
+    cp->end = end;
+
+    in >> cnt;
+    if (in.status() != QDataStream::Ok || cnt > 100)
+        return false;
+    cp->condvec.resize(cnt);
+    for (quint32 i = 0; i < cnt; i++)
+    {
+        readCondition(in, &cp->condvec[i]);
+        if (cp->condvec[i].type < 0 || cp->condvec[i].type >= FILTER_MAX)
+            return false;
+    }
+
+    in >> cnt >> data;
+    if (in.status() != QDataStream::Ok)
+        return false;
+    cp->seeds.clear();
+    return decodeSeeds(data, cnt, &cp->seeds);
+}
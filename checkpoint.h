@@ -0,0 +1,51 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include "search.h"
+
+#include <QString>
+#include <QVector>
+#include <QDataStream>
+
+#define CHECKPOINT_MAGIC    0x43564350 // "CVCP"
+#define CHECKPOINT_VERSION  1
+
+/* The state of a search that is needed to continue it later. The file format
+ * is a big endian QDataStream, where each field of the conditions is written
+ * separately, so it does not depend on the memory layout of the structs, and
+ * the results are sorted, delta encoded and compressed. The MC version and
+ * the filter types are written by name, so they do not depend on the order of
+ * the enums either.
+ */
+struct Checkpoint
+{
+    int searchtype;
+    int mc;
+    int64_t progress;           // next 48-bit seed base to search
+    int64_t end;                // last 48-bit seed base of the search range
+    QVector<Condition> condvec;
+    QVector<int64_t> seeds;     // results so far
+    QString listpath;           // input of a seed list search
+    int64_t listpos;            // bytes of the list that are done
+};
+
+/* Writes the fields of a condition, independent of the memory layout.
+ */
+void writeCondition(QDataStream& out, const Condition& c);
+
+/* Tests whether a file starts with the checkpoint magic number.
+ */
+bool isCheckpointFile(const QString& path);
+
+/* Writes a checkpoint. The file is replaced atomically, so an interruption
+ * leaves the previous checkpoint intact. Returns false on failure.
+ */
+bool saveCheckpoint(const QString& path, const Checkpoint& cp);
+
+/* Reads a checkpoint. Returns false if the file is not a checkpoint, was
+ * written by an incompatible version, or has an MC version or filter type that
+ * is not known.
+ */
+bool loadCheckpoint(const QString& path, Checkpoint *cp);
+
+#endif // CHECKPOINT_H
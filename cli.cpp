@@ -0,0 +1,355 @@
+#include "searchthread.h"
+#include "cutil.h"
+#include "seedreader.h"
+#include "workunits.h"
+#include "seedring.h"
+#include "searchdaemon.h"
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QTimer>
+
+#include <stdio.h>
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+
+/* Reads the conditions from a progress file, as saved by the GUI.
+ * The results that follow the conditions are not read, except for the search
+ * type and progress, which are used as defaults. Checkpoint files are read
+ * completely into 'cp'.
+ */
+static bool loadConditions(QString fnam, QVector<Condition> *condvec, int *searchtype, int64_t *s48,
+        Checkpoint *cp)
+{
+    if (isCheckpointFile(fnam))
+    {
+        if (!loadCheckpoint(fnam, cp))
+            return false;
+        *condvec = cp->condvec;
+        *searchtype = cp->searchtype;
+        *s48 = cp->progress;
+        return !condvec->empty();
+    }
+
+    SeedReader reader;
+    if (!reader.openFile(fnam))
+        return false;
+
+    // the header and conditions come before the seeds, which are not needed
+    QByteArray line;
+    while (reader.peek() == '#' && reader.readLine(&line))
+    {
+        if (line.startsWith("#Cond:"))
+        {
+            QByteArray ba = QByteArray::fromHex(line.mid(6).trimmed());
+            if (ba.size() != sizeof(Condition))
+                return false;
+            condvec->push_back(*(Condition*) ba.data());
+        }
+        else
+        {
+            sscanf(line.data(), "#Search: %d", searchtype);
+            sscanf(line.data(), "#Progress: %" PRId64, s48);
+        }
+    }
+    return !condvec->empty();
+}
+
+/* Restricts the process to a list of CPUs, such as "0-15,32-47".
+ * Returns the number of CPUs, or -1 if the list is invalid or affinity is not
+ * supported.
+ */
+static int setAffinity(QString cpus)
+{
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (const QString& part : cpus.split(','))
+    {
+        int a, b;
+        QByteArray ba = part.trimmed().toLatin1();
+        int n = sscanf(ba.data(), "%d-%d", &a, &b);
+        if (n == 1)
+            b = a;
+        if (n < 1 || a < 0 || b < a || b >= CPU_SETSIZE)
+            return -1;
+        for (int i = a; i <= b; i++)
+            CPU_SET(i, &set);
+    }
+    if (sched_setaffinity(0, sizeof(set), &set) != 0)
+        return -1;
+    return CPU_COUNT(&set);
+#else
+    (void) cpus;
+    return -1;
+#endif
+}
+
+static bool parseSeed(QString s, int64_t *seed)
+{
+    bool ok;
+    *seed = s.toLongLong(&ok, 0);
+    return ok;
+}
+
+int main(int argc, char *argv[])
+{
+    initBiomes();
+
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("cubiomes-cli");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(
+            "Headless seed search with the cubiomes-viewer search engine.\n"
+            "Conditions are read from a progress file saved by the GUI, "
+            "matching seeds are written line by line.");
+    parser.addHelpOption();
+    parser.addPositionalArgument("conditions", "Progress file or checkpoint with the search conditions.");
+    parser.addOptions({
+        {{"m", "mc"}, "Minecraft version (default: 1.16, or from checkpoint).", "version", "1.16"},
+        {{"s", "start"}, "First 48-bit seed base (default: progress of the file).", "s48"},
+        {{"e", "end"}, "Last 48-bit seed base (inclusive).", "s48"},
+        {{"t", "threads"}, "Number of worker threads (default: all cores).", "n"},
+        {{"o", "output"}, "Write seeds to a file instead of stdout.", "file"},
+        {"type", "Search type: all64, inc48, candidates or list (default: from file).", "type"},
+        {{"l", "list"}, "Check the seeds of this file instead of searching, one per line.", "file"},
+        {{"c", "checkpoint"}, "Keep a checkpoint of the search in this file, which can be "
+            "given as the conditions to resume.", "file"},
+        {"autosave", "Minutes between checkpoint updates (default: 10).", "minutes", "10"},
+        {"cache", "Directory of the cache for the seeds that pass the 48-bit conditions.", "dir"},
+        {"no-cache", "Do not use the 48-bit cache."},
+        {"coordinate", "Split the search into work units in a shared job directory, and merge "
+            "the results of the workers into its job.cvcp.", "dir"},
+        {"units", "Number of work units for --coordinate (default: 4096).", "n", "4096"},
+        {"lease", "Seconds after which the unit of an unresponsive worker is given out "
+            "again (default: 600).", "seconds", "600"},
+        {"worker", "Search the work units of a job directory.", "dir"},
+        {"affinity", "Run on these CPUs only, e.g. 0-15,32-47 (Linux).", "cpus"},
+        {"shm", "Search as a worker process of the viewer, with this shared memory.", "key"},
+        {"shm-index", "Index of the worker process.", "i", "0"},
+        {"daemon", "Serve searches on a local socket with this name or path.", "name"},
+    });
+    parser.process(app);
+
+    // the affinity is inherited by the threads that are started later
+    int threads = parser.value("threads").toInt();
+    if (parser.isSet("affinity"))
+    {
+        int n = setAffinity(parser.value("affinity"));
+        if (n < 0)
+        {
+            fprintf(stderr, "Failed to set the CPU affinity: %s\n", parser.value("affinity").toLocal8Bit().data());
+            return 1;
+        }
+        if (!parser.isSet("threads"))
+            threads = n;
+    }
+
+    QString cachedir;
+    if (!parser.isSet("no-cache"))
+        cachedir = parser.isSet("cache") ? parser.value("cache") : CACHE48_DIR;
+
+    if (parser.isSet("worker"))
+        return runWorker(parser.value("worker"), threads, cachedir);
+
+    if (parser.isSet("daemon"))
+    {
+        SearchDaemon daemon(threads, cachedir);
+        if (!daemon.listen(parser.value("daemon")))
+            return 1;
+        return app.exec();
+    }
+
+    const QStringList args = parser.positionalArguments();
+    if (parser.isSet("coordinate") && args.empty())
+    {
+        // continue an existing job
+        return runCoordinator(parser.value("coordinate"), Checkpoint(),
+                parser.value("units").toInt(), parser.value("lease").toInt());
+    }
+    if (args.size() != 1)
+        parser.showHelp(1);
+
+    int mc = str2mc(parser.value("mc").toLatin1().data());
+    if (mc < 0)
+    {
+        fprintf(stderr, "Unknown MC version: %s\n", parser.value("mc").toLocal8Bit().data());
+        return 1;
+    }
+
+    QVector<Condition> condvec;
+    int searchtype = SEARCH_ALL64;
+    int64_t sstart = 0, send = MASK48;
+    Checkpoint cp = {};
+    if (!loadConditions(args[0], &condvec, &searchtype, &sstart, &cp))
+    {
+        fprintf(stderr, "Failed to read conditions from: %s\n", args[0].toLocal8Bit().data());
+        return 1;
+    }
+    if (!cp.condvec.empty())
+    {
+        // a checkpoint also provides the defaults for the version and range
+        if (!parser.isSet("mc"))
+            mc = cp.mc;
+        send = cp.end;
+    }
+
+    if ((parser.isSet("start") && !parseSeed(parser.value("start"), &sstart)) ||
+        (parser.isSet("end") && !parseSeed(parser.value("end"), &send)))
+    {
+        fprintf(stderr, "Invalid seed range.\n");
+        return 1;
+    }
+
+    if (parser.isSet("type"))
+    {
+        QString t = parser.value("type");
+        if (t == "all64") searchtype = SEARCH_ALL64;
+        else if (t == "inc48") searchtype = SEARCH_INC48;
+        else if (t == "candidates") searchtype = SEARCH_CANDIT;
+        else if (t == "list") searchtype = SEARCH_LIST;
+        else
+        {
+            fprintf(stderr, "Unknown search type: %s\n", t.toLocal8Bit().data());
+            return 1;
+        }
+    }
+
+    if (parser.isSet("list"))
+        searchtype = SEARCH_LIST;
+    QString listpath = parser.value("list");
+    int64_t listpos = 0;
+    if (searchtype == SEARCH_LIST)
+    {
+        // a checkpoint of a list search continues where it was in its list
+        if (cp.searchtype == SEARCH_LIST && !cp.listpath.isEmpty())
+        {
+            if (listpath.isEmpty())
+                listpath = cp.listpath;
+            if (QFileInfo(listpath).absoluteFilePath() == cp.listpath)
+                listpos = cp.listpos;
+        }
+        if (listpath.isEmpty())
+        {
+            fprintf(stderr, "A seed list is required for the list search.\n");
+            return 1;
+        }
+        // the progress covers the list rather than a range of seeds
+        sstart = 0;
+        send = MASK48;
+    }
+
+    // a checkpoint of a finished search continues after its end
+    if (!parser.isSet("start") && sstart == send + 1)
+    {
+        fprintf(stderr, "The search is complete.\n");
+        return 0;
+    }
+    if (sstart < 0 || sstart > MASK48 || send < 0 || send > MASK48 || sstart > send)
+    {
+        fprintf(stderr, "Invalid seed range, the 48-bit range has to lie within [0, %" PRId64 "].\n", (int64_t)MASK48);
+        return 1;
+    }
+
+    if (parser.isSet("coordinate"))
+    {
+        if (searchtype == SEARCH_LIST)
+        {
+            fprintf(stderr, "Seed lists cannot be split into work units.\n");
+            return 1;
+        }
+        Checkpoint job = { searchtype, mc, sstart, send, condvec, cp.seeds, QString(), 0 };
+        return runCoordinator(parser.value("coordinate"), job,
+                parser.value("units").toInt(), parser.value("lease").toInt());
+    }
+
+    if (parser.isSet("shm"))
+    {
+        // results and progress go to the viewer that started this process
+        SearchThread sthread(&app);
+        sthread.setThreads(threads);
+        sthread.setCacheDir(cachedir);
+        return runRingWorker(sthread, parser.value("shm"), parser.value("shm-index").toInt(),
+                searchtype, mc, condvec);
+    }
+
+    FILE *fp = stdout;
+    if (parser.isSet("output"))
+    {
+        fp = fopen(parser.value("output").toLocal8Bit().data(), "a");
+        if (!fp)
+        {
+            fprintf(stderr, "Failed to open output file.\n");
+            return 1;
+        }
+    }
+
+    SearchThread sthread(&app);
+    sthread.setThreads(threads);
+    sthread.setCacheDir(cachedir);
+    if (!sthread.set(searchtype, sstart, send, mc, condvec))
+        return 1;
+    if (searchtype == SEARCH_LIST && !sthread.setSeedList(listpath, listpos))
+        return 1;
+    if (parser.isSet("checkpoint"))
+    {
+        // results of a resumed checkpoint are carried over, not written again
+        sthread.setCheckpoint(parser.value("checkpoint"),
+                parser.value("autosave").toInt(), cp.seeds);
+    }
+
+    int64_t found = 0;
+    QElapsedTimer timer;
+
+    // results and progress are polled from the search
+    auto poll = [&]() {
+        int64_t s48 = sthread.progress();
+        QVector<int64_t> seeds;
+        if (sthread.takeResults(seeds))
+        {
+            for (int64_t s : seeds)
+                fprintf(fp, "%" PRId64 "\n", s);
+            fflush(fp);
+            found += seeds.size();
+        }
+        if (s48 >= sstart)
+        {
+            fprintf(stderr, "Progress: %" PRId64 " (%.4f%%)\r", s48,
+                    100.0 * (s48 - sstart) / (send - sstart + 1));
+        }
+    };
+    QTimer ptimer;
+    QObject::connect(&ptimer, &QTimer::timeout, &app, poll);
+    ptimer.start(500);
+
+    QObject::connect(&sthread, &SearchThread::finish, &app,
+        [&](int64_t s48) {
+            poll();
+            double sec = timer.elapsed() * 1e-3;
+            int64_t bases = s48 - sstart;
+            if (searchtype == SEARCH_LIST)
+            {
+                fprintf(stderr, "\nFound %" PRId64 " seeds in %.1f s\n", found, sec);
+                app.quit();
+                return;
+            }
+            fprintf(stderr, "\nFinished at: %" PRId64 "\n", s48);
+            fprintf(stderr, "Found %" PRId64 " seeds, %" PRId64 " bases in %.1f s (%.1f bases/s)\n",
+                    found, bases, sec, sec > 0 ? bases / sec : 0.0);
+            app.quit();
+        });
+
+    timer.start();
+    sthread.start();
+    int ret = app.exec();
+    sthread.wait();
+
+    if (fp != stdout)
+        fclose(fp);
+    return ret;
+}
@@ -0,0 +1,50 @@
+#-------------------------------------------------
+#
+# Headless search frontend, which shares the search engine with the viewer.
+#
+#-------------------------------------------------
+
+QT      += core network
+QT      -= gui
+LIBS    += -lm $$PWD/cubiomes/libcubiomes.a
+
+win32: {
+    LIBS += -static -static-libgcc -static-libstdc++
+}
+
+QMAKE_CFLAGS    =  -fwrapv
+QMAKE_CXXFLAGS  =  $$QMAKE_CFLAGS
+QMAKE_CXXFLAGS_RELEASE *= -O3
+
+TARGET = cubiomes-cli
+
+CONFIG += static console
+CONFIG -= app_bundle
+
+
+SOURCES += \
+        search.cpp \
+        searchthread.cpp \
+        checkpoint.cpp \
+        seedreader.cpp \
+        survivorcache.cpp \
+        workunits.cpp \
+        seedring.cpp \
+        searchdaemon.cpp \
+        cli.cpp
+
+HEADERS += \
+        cubiomes/finders.h \
+        cubiomes/generator.h \
+        cubiomes/javarnd.h \
+        cubiomes/layers.h \
+        cubiomes/util.h \
+        cutil.h \
+        search.h \
+        searchthread.h \
+        checkpoint.h \
+        seedreader.h \
+        survivorcache.h \
+        workunits.h \
+        seedring.h \
+        searchdaemon.h
@@ -45,6 +45,12 @@ SOURCES += \
         quad.cpp \
         search.cpp \
         searchthread.cpp \
+        checkpoint.cpp \
+        seedreader.cpp \
+        survivorcache.cpp \
+        seedring.cpp \
+        processsearch.cpp \
+        seedtablemodel.cpp \
         main.cpp
 
 HEADERS += \
@@ -63,7 +69,13 @@ HEADERS += \
         quad.h \
         cutil.h \
         search.h \
-        searchthread.h
+        searchthread.h \
+        checkpoint.h \
+        seedreader.h \
+        survivorcache.h \
+        seedring.h \
+        processsearch.h \
+        seedtablemodel.h
 
 FORMS += \
         aboutdialog.ui \
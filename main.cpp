@@ -1,5 +1,6 @@
 #include "mainwindow.h"
 #include <QApplication>
+#include <QThread>
 
 #include "quad.h"
 
@@ -10,6 +11,32 @@ MainWindow *gMainWindowInstance;
 unsigned char biomeColors[256][3];
 unsigned char tempsColors[256][3];
 
+// the search hooks can be called from the GUI thread as well as from the
+// search thread, in which case they have to wait for the GUI to respond
+static Qt::ConnectionType guiConnection()
+{
+    if (QThread::currentThread() == gMainWindowInstance->thread())
+        return Qt::DirectConnection;
+    return Qt::BlockingQueuedConnection;
+}
+
+static void guiMessage(int level, QString title, QString text)
+{
+    QMetaObject::invokeMethod(
+            gMainWindowInstance, level == MSG_WARN ? "warning" : "information",
+            guiConnection(), Q_ARG(QString, title), Q_ARG(QString, text));
+}
+
+static void guiProtobaseOpen(QString path)
+{
+    QMetaObject::invokeMethod(gMainWindowInstance, "openProtobaseMsg", Qt::QueuedConnection, Q_ARG(QString, path));
+}
+
+static void guiProtobaseClose()
+{
+    QMetaObject::invokeMethod(gMainWindowInstance, "closeProtobaseMsg", guiConnection());
+}
+
 int main(int argc, char *argv[])
 {
     initBiomes();
@@ -19,6 +46,7 @@ int main(int argc, char *argv[])
     QApplication a(argc, argv);
     MainWindow mw;
     gMainWindowInstance = &mw;
+    g_searchhooks = { guiMessage, guiProtobaseOpen, guiProtobaseClose };
     mw.show();
     int ret = a.exec();
     gMainWindowInstance = NULL;
@@ -6,6 +6,8 @@
 #include "aboutdialog.h"
 #include "quad.h"
 #include "cutil.h"
+#include "seedreader.h"
+#include "survivorcache.h"
 
 #include <QIntValidator>
 #include <QMetaType>
@@ -17,10 +19,14 @@
 #include <QFont>
 #include <QFileDialog>
 #include <QTextStream>
+#include <QItemSelectionModel>
+#include <QProgressDialog>
 
 #include <stdlib.h>
+#include <stdio.h>
 
-#define MAXRESULTS 65535
+#define MAXRESULTS (1 << 24)
+#define AUTOSAVE_MINUTES 10
 
 
 QDataStream& operator<<(QDataStream& out, const Condition& v)
@@ -39,6 +45,8 @@ MainWindow::MainWindow(QWidget *parent) :
     QMainWindow(parent),
     ui(new Ui::MainWindow),
     sthread(this),
+    psearch(this),
+    procsearch(false),
     stimer(this)
 {
     ui->setupUi(this);
@@ -55,6 +63,12 @@ MainWindow::MainWindow(QWidget *parent) :
     ui->listConditionsFull->setFont(mono);
     ui->listResults->setFont(mono);
 
+    seedmodel = new SeedTableModel(this);
+    ui->listResults->setModel(seedmodel);
+    ui->listResults->sortByColumn(-1, Qt::AscendingOrder);
+    connect(ui->listResults->selectionModel(), &QItemSelectionModel::currentRowChanged,
+            this, &MainWindow::resultCurrentChanged);
+
     qRegisterMetaType< int64_t >("int64_t");
     qRegisterMetaType< QVector<int64_t> >("QVector<int64_t>");
     qRegisterMetaType< Condition >("Condition");
@@ -62,11 +76,16 @@ MainWindow::MainWindow(QWidget *parent) :
 
     protodialog = new ProtoBaseDialog(this);
 
-    connect(&sthread, &SearchThread::results, this, &MainWindow::searchResultsAdd, Qt::BlockingQueuedConnection);
-    connect(&sthread, &SearchThread::baseDone, this, &MainWindow::searchBaseDone, Qt::BlockingQueuedConnection);
     connect(&sthread, &SearchThread::finish, this, &MainWindow::searchFinish);
+    connect(&psearch, &ProcessSearch::finish, this, &MainWindow::searchFinish);
     connect(ui->checkStop, &QAbstractButton::toggled, &sthread, &SearchThread::setStopOnResult, Qt::DirectConnection);
     sthread.setStopOnResult(ui->checkStop->isChecked());
+    // the search types of the items, as not every type is offered
+    ui->comboSearchType->setItemData(0, SEARCH_ALL64);
+    ui->comboSearchType->setItemData(1, SEARCH_INC48);
+    ui->comboSearchType->setItemData(2, SEARCH_LIST);
+    sthread.setCacheDir(CACHE48_DIR);
+    psearch.setCacheDir(CACHE48_DIR);
 
     connect(&stimer, &QTimer::timeout, this, QOverload<>::of(&MainWindow::resultTimeout));
     stimer.start(500);
@@ -82,9 +101,23 @@ MainWindow::~MainWindow()
     sthread.stop(); // tell search to stop at next convenience
     sthread.quit(); // tell the event loop to exit
     sthread.wait(); // wait for search to finish
+    psearch.stop();
     delete ui;
 }
 
+int MainWindow::getSearchType() const
+{
+    return ui->comboSearchType->currentData().toInt();
+}
+
+// selects the item of a search type, types that are not offered are ignored
+void MainWindow::setSearchType(int searchtype)
+{
+    int idx = ui->comboSearchType->findData(searchtype);
+    if (idx >= 0)
+        ui->comboSearchType->setCurrentIndex(idx);
+}
+
 QVector<Condition> MainWindow::getConditions() const
 {
     QVector<Condition> conds;
@@ -202,6 +235,53 @@ void MainWindow::setItemCondition(QListWidget *list, QListWidgetItem *item, Cond
 
     item->setText(s);
     item->setData(Qt::UserRole, QVariant::fromValue(cond));
+    item->setData(Qt::UserRole+2, s);
+}
+
+// appends the profiling counters of the running search to the condition items
+void MainWindow::updateConditionStats()
+{
+    QListWidget *lists[] = { ui->listConditions48, ui->listConditionsFull };
+    int stages[] = { STAGE_48, STAGE_FULL };
+    uint64_t total[STAGE_NUM] = {};
+
+    for (int i = 0; i < 100; i++)
+        for (int j = 0; j < STAGE_NUM; j++)
+            total[j] += sthread.stats[i].tsc[j];
+
+    for (int k = 0; k < 2; k++)
+    {
+        int n = lists[k]->count();
+        for (int i = 0; i < n; i++)
+        {
+            QListWidgetItem *item = lists[k]->item(i);
+            if (!(item->flags() & Qt::ItemIsSelectable))
+                continue;
+            Condition cond = qvariant_cast<Condition>(item->data(Qt::UserRole));
+            QString s = item->data(Qt::UserRole+2).toString();
+            if (cond.save < 1 || cond.save > 99)
+                continue;
+
+            const CondStats& cs = sthread.stats[cond.save];
+            int j = stages[k];
+            uint64_t cnt = cs.cnt[j], pass = cs.pass[j], tsc = cs.tsc[j];
+            if (cnt)
+            {
+                s += QString::asprintf("  {%.2f%% passed, %.1f%% time}",
+                        100.0 * pass / cnt, total[j] ? 100.0 * tsc / total[j] : 0.0);
+            }
+            item->setText(s);
+
+            QString tip;
+            for (j = 0; j < STAGE_NUM; j++)
+            {
+                cnt = cs.cnt[j], pass = cs.pass[j], tsc = cs.tsc[j];
+                tip += QString::asprintf("%s stage: %" PRIu64 " tests, %" PRIu64 " passed, %.1f Mcycles\n",
+                        j == STAGE_48 ? "48-bit" : "Full", cnt, pass, tsc * 1e-6);
+            }
+            item->setToolTip(tip.trimmed());
+        }
+    }
 }
 
 void MainWindow::editCondition(QListWidgetItem *item)
@@ -268,6 +348,11 @@ void MainWindow::warning(QString title, QString text)
     QMessageBox::warning(this, title, text, QMessageBox::Ok);
 }
 
+void MainWindow::information(QString title, QString text)
+{
+    QMessageBox::information(this, title, text, QMessageBox::Ok);
+}
+
 void MainWindow::mapGoto(qreal x, qreal z)
 {
     ui->mapView->setView(x, z);
@@ -422,8 +507,7 @@ void MainWindow::on_listConditionsFull_itemSelectionChanged()
 
 void MainWindow::on_buttonClear_clicked()
 {
-    ui->listResults->clearContents();
-    ui->listResults->setRowCount(0);
+    seedmodel->clear();
     ui->lineStart48->setText("0");
     ui->progressBar->setValue(0);
     ui->progressBar->setFormat("0.00%");
@@ -437,7 +521,7 @@ void MainWindow::on_buttonStart_clicked()
         getSeed(&mc, NULL);
         QVector<Condition> condvec = getConditions();
         int64_t sstart = (int64_t)ui->lineStart48->text().toLongLong() & MASK48;
-        int searchtype = ui->comboSearchType->currentIndex();
+        int searchtype = getSearchType();
         int ok = true;
 
         if (condvec.empty())
@@ -445,14 +529,34 @@ void MainWindow::on_buttonStart_clicked()
             warning("Warning", "Please define some constraints using the \"Add\" button.");
             ok = false;
         }
-        if (sthread.isRunning())
+        if (sthread.isRunning() || psearch.isRunning())
         {
             warning("Warning", "Search is still running.");
             ok = false;
         }
 
         if (ok)
-            ok = sthread.set(searchtype, sstart, mc, condvec);
+            ok = sthread.set(searchtype, sstart, MASK48, mc, condvec);
+        if (ok && searchtype == SEARCH_LIST)
+        {
+            QString fnam = QFileDialog::getOpenFileName(this, "Seed list to filter", prevdir,
+                    "Seed lists (*.txt);;Any files (*)");
+            ok = !fnam.isEmpty() && sthread.setSeedList(fnam);
+            if (ok)
+                prevdir = QFileInfo(fnam).absolutePath();
+        }
+        if (ok && !ckptpath.isEmpty())
+            sthread.setCheckpoint(ckptpath, AUTOSAVE_MINUTES, seedmodel->getSeeds());
+
+        // the seed list search reads its input in this process
+        procsearch = ui->actionSearchProcesses->isChecked() && searchtype != SEARCH_LIST;
+        if (ok && procsearch)
+            ok = psearch.start(searchtype, sstart, MASK48, mc, condvec);
+        if (ok && procsearch && !ckptpath.isEmpty())
+        {
+            pckpt = { searchtype, mc, sstart, MASK48, condvec, {}, QString(), 0 };
+            pckpttimer.start();
+        }
 
         if (ok)
         {
@@ -460,7 +564,8 @@ void MainWindow::on_buttonStart_clicked()
             ui->comboSearchType->setEnabled(false);
             ui->buttonStart->setText("Abort search");
             ui->buttonStart->setIcon(QIcon::fromTheme("process-stop"));
-            sthread.start();
+            if (!procsearch)
+                sthread.start();
         }
         else
         {
@@ -472,6 +577,7 @@ void MainWindow::on_buttonStart_clicked()
         sthread.stop(); // tell search to stop at next convenience
         sthread.quit(); // tell the event loop to exit
         //sthread.wait(); // wait for search to finish
+        psearch.stop();
         ui->buttonStart->setEnabled(true);
         ui->buttonStart->setText("Start search");
         ui->buttonStart->setIcon(QIcon::fromTheme("system-search"));
@@ -482,12 +588,12 @@ void MainWindow::on_buttonStart_clicked()
 }
 
 
-void MainWindow::on_listResults_itemSelectionChanged()
+void MainWindow::resultCurrentChanged(const QModelIndex& current)
 {
-    int row = ui->listResults->currentRow();
-    if (row >= 0 && row < ui->listResults->rowCount())
+    int row = current.row();
+    if (current.isValid() && row < seedmodel->rowCount())
     {
-        int64_t s = ui->listResults->item(row, 0)->data(Qt::UserRole).toLongLong();
+        int64_t s = seedmodel->seedAt(row);
         ui->seedEdit->setText(QString::asprintf("%" PRId64, s));
         on_seedEdit_editingFinished();
     }
@@ -498,10 +604,13 @@ void MainWindow::on_listResults_customContextMenuRequested(const QPoint &pos)
     QMenu menu(this);
 
     QAction *actremove = menu.addAction(QIcon::fromTheme("list-remove"), "Remove selected seed", this, &MainWindow::removeCurrent);
-    actremove->setEnabled(!ui->listResults->selectedItems().empty());
+    actremove->setEnabled(ui->listResults->selectionModel()->hasSelection());
+
+    QAction *actrefine = menu.addAction(QIcon::fromTheme("edit-find"), "Refine with current conditions", this, &MainWindow::refineResults);
+    actrefine->setEnabled(seedmodel->rowCount() > 0 && !sthread.isRunning() && !psearch.isRunning());
 
     QAction *actcopy = menu.addAction(QIcon::fromTheme("edit-copy"), "Copy list to clipboard", this, &MainWindow::copyResults);
-    actcopy->setEnabled(ui->listResults->rowCount() > 0);
+    actcopy->setEnabled(seedmodel->rowCount() > 0);
 
     int n = pasteList(true);
     QAction *actpaste = menu.addAction(QIcon::fromTheme("edit-paste"), QString::asprintf("Paste %d seeds from clipboard", n), this, &MainWindow::pasteResults);
@@ -518,10 +627,11 @@ void MainWindow::on_buttonInfo_clicked()
             "\n\n"
             "Conditions can reference each other for relative positions "
             "(indicated with the ID in square brackets [XY]). "
-            "The conditions will be checked in the same order they are listed, "
-            "so make sure that references are not broken."
+            "The search reorders the conditions so that cheap and selective "
+            "checks are done first, while keeping each condition after the one "
+            "it references, so the listed order does not matter."
             "\n\n"
-            "You can edit existing conditions by double-clicking, and use drag to reorder them. "
+            "You can edit existing conditions by double-clicking. "
     ;
     QMessageBox::information(this, "Help: search conditions", msg, QMessageBox::Ok);
 }
@@ -529,13 +639,35 @@ void MainWindow::on_buttonInfo_clicked()
 
 void MainWindow::on_actionSave_triggered()
 {
-    QString fnam = QFileDialog::getSaveFileName(this, "Save progress", prevdir, "Text files (*.txt);;Any files (*)");
+    QString fnam = QFileDialog::getSaveFileName(this, "Save progress", prevdir,
+            "Checkpoint files (*.cvcp);;Text files (*.txt);;Any files (*)");
     if (!fnam.isEmpty())
     {
         QFileInfo finfo(fnam);
         QFile file(fnam);
         prevdir = finfo.absolutePath();
 
+        if (finfo.suffix() == "cvcp")
+        {
+            Checkpoint cp;
+            cp.mc = MC_1_16;
+            getSeed(&cp.mc, NULL);
+            cp.searchtype = getSearchType();
+            cp.progress = ui->lineStart48->text().toLongLong();
+            cp.end = MASK48;
+            cp.condvec = getConditions();
+            cp.seeds = seedmodel->getSeeds();
+            cp.listpos = 0;
+            if (!saveCheckpoint(fnam, cp))
+            {
+                warning("Warning", "Failed to write checkpoint.");
+                return;
+            }
+            // searches started from now on will keep the checkpoint updated
+            ckptpath = fnam;
+            return;
+        }
+
         if (!file.open(QIODevice::WriteOnly))
         {
             warning("Warning", "Failed to open file.");
@@ -544,37 +676,60 @@ void MainWindow::on_actionSave_triggered()
 
         QTextStream stream(&file);
         stream << "#Version:  " << VERS_MAJOR << "." << VERS_MINOR << "." << VERS_PATCH << "\n";
-        stream << "#Search:   " << ui->comboSearchType->currentIndex() << "\n";
+        stream << "#Search:   " << getSearchType() << "\n";
         stream << "#Progress: " << ui->lineStart48->text().toLongLong() << "\n";
         QVector<Condition> condvec = getConditions();
         for (Condition &c : condvec)
             stream << "#Cond: " << QByteArray((const char*) &c, sizeof(Condition)).toHex() << "\n";
 
-        int n = ui->listResults->rowCount();
-        for (int i = 0; i < n; i++)
-        {
-            int64_t seed = ui->listResults->item(i, 0)->data(Qt::UserRole).toLongLong();
+        for (int64_t seed : seedmodel->getSeeds())
             stream << QString::asprintf("%" PRId64 "\n", seed);
-        }
     }
 }
 
 void MainWindow::on_actionLoad_triggered()
 {
-    if (ui->buttonStart->isChecked() || sthread.isRunning())
+    if (ui->buttonStart->isChecked() || sthread.isRunning() || psearch.isRunning())
     {
         warning("Warning", "Cannot load progress: search is still active.");
         return;
     }
 
-    QString fnam = QFileDialog::getOpenFileName(this, "Load progress", prevdir, "Text files (*.txt);;Any files (*)");
+    QString fnam = QFileDialog::getOpenFileName(this, "Load progress", prevdir,
+            "Progress files (*.cvcp *.txt);;Any files (*)");
     if (!fnam.isEmpty())
     {
         QFileInfo finfo(fnam);
-        QFile file(fnam);
         prevdir = finfo.absolutePath();
 
-        if (!file.open(QIODevice::ReadOnly))
+        if (isCheckpointFile(fnam))
+        {
+            Checkpoint cp;
+            if (!loadCheckpoint(fnam, &cp))
+            {
+                warning("Warning", "Failed to read checkpoint, or it was created with a newer version.");
+                return;
+            }
+            on_buttonRemoveAll_clicked();
+            on_buttonClear_clicked();
+
+            int64_t seed;
+            if (getSeed(NULL, &seed, false))
+                setSeed(cp.mc, seed);
+            setSearchType(cp.searchtype);
+            ui->lineStart48->setText(QString::asprintf("%" PRId64, cp.progress));
+            for (Condition &c : cp.condvec)
+            {
+                QListWidgetItem *item = new QListWidgetItem();
+                addItemCondition(item, c);
+            }
+            searchResultsAdd(cp.seeds, false);
+            ckptpath = fnam;
+            return;
+        }
+
+        SeedReader reader;
+        if (!reader.openFile(fnam))
         {
             warning("Warning", "Failed to open file.");
             return;
@@ -586,51 +741,37 @@ void MainWindow::on_actionLoad_triggered()
         QVector<Condition> condvec;
         QVector<int64_t> seeds;
 
-        QTextStream stream(&file);
-        QString line;
-        line = stream.readLine();
-        if (sscanf(line.toLatin1().data(), "#Version: %d.%d.%d", &major, &minor, &patch) != 3)
+        // the header and conditions come before the seeds
+        QByteArray line;
+        reader.readLine(&line);
+        if (sscanf(line.data(), "#Version: %d.%d.%d", &major, &minor, &patch) != 3)
             goto L_read_failed;
         if (cmpVers(major, minor, patch) > 0)
             warning("Warning", "Progress file was created with a newer version.");
 
-        line = stream.readLine();
-        if (sscanf(line.toLatin1().data(), "#Search: %d", &searchtype) != 1)
+        reader.readLine(&line);
+        if (sscanf(line.data(), "#Search: %d", &searchtype) != 1)
             goto L_read_failed;
 
-        line = stream.readLine();
-        if (sscanf(line.toLatin1().data(), "#Progress: %" PRId64, &s48) != 1)
+        reader.readLine(&line);
+        if (sscanf(line.data(), "#Progress: %" PRId64, &s48) != 1)
             goto L_read_failed;
 
-        while (stream.status() == QTextStream::Ok)
+        while (reader.peek() == '#')
         {
-            line = stream.readLine();
-            if (line.isEmpty())
-                break;
-            if (line.startsWith("#Cond:"))
-            {
-                QString hex = line.mid(6).trimmed();
-                QByteArray ba = QByteArray::fromHex(QByteArray(hex.toLatin1().data()));
-                if (ba.size() == sizeof(Condition))
-                {
-                    Condition c = *(Condition*) ba.data();
-                    condvec.push_back(c);
-                }
-                else goto L_read_failed;
-            }
-            else
-            {
-                int64_t seed;
-                if (sscanf(line.toLatin1().data(), "%" PRId64, &seed) == 1)
-                    seeds.push_back(seed);
-                else goto L_read_failed;
-            }
+            reader.readLine(&line);
+            if (!line.startsWith("#Cond:"))
+                goto L_read_failed;
+            QByteArray ba = QByteArray::fromHex(line.mid(6).trimmed());
+            if (ba.size() != sizeof(Condition))
+                goto L_read_failed;
+            condvec.push_back(*(Condition*) ba.data());
         }
 
         on_buttonRemoveAll_clicked();
         on_buttonClear_clicked();
 
-        ui->comboSearchType->setCurrentIndex(searchtype);
+        setSearchType(searchtype);
         ui->lineStart48->setText(QString::asprintf("%" PRId64, s48));
 
         for (Condition &c : condvec)
@@ -638,8 +779,11 @@ void MainWindow::on_actionLoad_triggered()
             QListWidgetItem *item = new QListWidgetItem();
             addItemCondition(item, c);
         }
+        ckptpath.clear();
 
-        searchResultsAdd(seeds, false);
+        if (!loadSeedList(reader))
+            warning("Warning", QString::asprintf(
+                    "Failed to parse progress file at line %" PRId64 ".", reader.lineNumber()));
 
         return;
 L_read_failed:
@@ -647,6 +791,40 @@ L_read_failed:
     }
 }
 
+/* Adds the seeds of a list to the results in chunks, so that the list does not
+ * have to be held in memory a second time, with a progress dialog for lists
+ * that take a while. Returns false if the list could not be parsed completely.
+ */
+bool MainWindow::loadSeedList(SeedReader& reader)
+{
+    const int chunksiz = 1 << 18;
+    QProgressDialog progress("Loading seeds...", "Cancel", 0, 1000, this);
+    progress.setWindowModality(Qt::WindowModal);
+    progress.setMinimumDuration(500);
+
+    QVector<int64_t> seeds;
+    seeds.reserve(chunksiz);
+    bool ok = true;
+
+    while (!reader.atEnd() && seedmodel->rowCount() < MAXRESULTS)
+    {
+        seeds.clear();
+        int n = reader.readSeeds(&seeds, chunksiz);
+        if (n > 0)
+            searchResultsAdd(seeds, false);
+        if (n < 0 || (n == 0 && !reader.atEnd()))
+        {
+            ok = false;
+            break;
+        }
+        progress.setValue(reader.position() * 1000 / reader.size());
+        if (progress.wasCanceled())
+            break;
+    }
+    progress.setValue(1000);
+    return ok;
+}
+
 void MainWindow::on_actionGo_to_triggered()
 {
     GotoDialog *dialog = new GotoDialog(this, ui->mapView->getX(), ui->mapView->getZ());
@@ -675,6 +853,24 @@ void MainWindow::on_actionAbout_triggered()
     dialog->show();
 }
 
+void MainWindow::on_actionSurvivorCache_toggled(bool enable)
+{
+    QString dir = enable ? CACHE48_DIR : QString();
+    sthread.setCacheDir(dir);
+    psearch.setCacheDir(dir);
+}
+
+void MainWindow::on_actionClearSurvivorCache_triggered()
+{
+    // a running search keeps its cache, which is only removed afterwards
+    if (sthread.isRunning() || psearch.isRunning())
+    {
+        warning("Warning", "Cannot clear the cache while a search is active.");
+        return;
+    }
+    SurvivorCache::clear(CACHE48_DIR);
+}
+
 void MainWindow::on_mapView_customContextMenuRequested(const QPoint &pos)
 {
     QMenu menu(this);
@@ -736,62 +932,29 @@ void MainWindow::addItemCondition(QListWidgetItem *item, Condition cond)
 
 int MainWindow::searchResultsAdd(QVector<int64_t> seeds, bool countonly)
 {
-    int ns = ui->listResults->rowCount();
-    int n = ns;
-    if (n >= MAXRESULTS)
-        return 0;
-    if (seeds.size() + n > MAXRESULTS)
-        seeds.resize(MAXRESULTS - n);
-    if (seeds.empty())
-        return 0;
-
-    QSet<int64_t> current;
-    current.reserve(n + seeds.size());
-    for (int i = 0; i < n; i++)
-    {
-        int64_t seed = ui->listResults->item(i, 0)->data(Qt::UserRole).toLongLong();
-        current.insert(seed);
-    }
+    int n = seedmodel->insertSeeds(seeds, countonly, MAXRESULTS);
 
-    ui->listResults->setSortingEnabled(false);
-    for (int64_t s : seeds)
-    {
-        if (current.contains(s))
-            continue;
-        if (countonly)
-        {
-            n++;
-            continue;
-        }
-        current.insert(s);
-        QTableWidgetItem* s48item = new QTableWidgetItem();
-        QTableWidgetItem* seeditem = new QTableWidgetItem();
-        s48item->setData(Qt::UserRole, QVariant::fromValue(s));
-        s48item->setText(QString::asprintf("%012llx|%04x",
-                (qulonglong)(s & MASK48), (uint)(s >> 48) & ((1 << 16) - 1)));
-        seeditem->setData(Qt::DisplayRole, QVariant::fromValue(s));
-        ui->listResults->insertRow(n);
-        ui->listResults->setItem(n, 0, s48item);
-        ui->listResults->setItem(n, 1, seeditem);
-        n++;
-    }
-    ui->listResults->setSortingEnabled(true);
-
-    if (countonly == false && n >= MAXRESULTS)
+    if (countonly == false && seedmodel->rowCount() >= MAXRESULTS)
     {
         sthread.stop();
+        psearch.stop();
         warning("Warning", QString::asprintf("Maximum number of results reached (%d).", MAXRESULTS));
     }
 
     if (ui->checkStop->isChecked())
+    {
         sthread.stop();
+        psearch.stop();
+    }
 
-    return n - ns;
+    return n;
 }
 
 void MainWindow::searchBaseDone(int64_t s48)
 {
-    ui->lineStart48->setText(QString::asprintf("%" PRId64, s48 + 1));
+    // the progress of a seed list search is not a 48-bit seed to resume from
+    if (sthread.searchType() != SEARCH_LIST)
+        ui->lineStart48->setText(QString::asprintf("%" PRId64, s48 + 1));
     int v = (s48 * 10000) >> 48;
     if (ui->progressBar->value() != v)
     {
@@ -802,9 +965,21 @@ void MainWindow::searchBaseDone(int64_t s48)
 
 void MainWindow::searchFinish(int64_t s48)
 {
+    pollSearch();
+    saveProcessCheckpoint(s48 - 1, true);
+    updateConditionStats();
+    if (!refineseeds.empty())
+    {
+        // an incomplete refinement keeps the seeds that passed, along with
+        // the seeds that were not checked
+        if (s48 < MASK48)
+            seedmodel->insertSeeds(refineseeds.mid((int)sthread.listDone()), false, MAXRESULTS);
+        refineseeds.clear();
+    }
     if (s48 >= MASK48)
     {
-        ui->lineStart48->setText(QString::asprintf("%" PRId64, MASK48));
+        if (sthread.searchType() != SEARCH_LIST)
+            ui->lineStart48->setText(QString::asprintf("%" PRId64, MASK48));
         ui->progressBar->setValue(10000);
         ui->progressBar->setFormat(QString::asprintf("Done"));
     }
@@ -814,25 +989,95 @@ void MainWindow::searchFinish(int64_t s48)
 
 void MainWindow::resultTimeout()
 {
+    if (sthread.isRunning() || psearch.isRunning())
+    {
+        pollSearch();
+        updateConditionStats();
+    }
     update();
 }
 
+// takes the results and progress that the search has made available so far
+void MainWindow::pollSearch()
+{
+    // the progress has to be read first, as it only covers queued results
+    int64_t s48 = procsearch ? psearch.progress() : sthread.progress();
+    QVector<int64_t> seeds;
+    if (procsearch ? psearch.takeResults(seeds) : sthread.takeResults(seeds))
+        searchResultsAdd(seeds, false);
+    if (s48 >= 0)
+    {
+        searchBaseDone(s48);
+        saveProcessCheckpoint(s48, false);
+    }
+}
+
+/* The worker processes do not keep the checkpoint, so the viewer writes it from
+ * their progress and the results that have been merged into the table.
+ */
+void MainWindow::saveProcessCheckpoint(int64_t s48, bool force)
+{
+    if (!procsearch || ckptpath.isEmpty())
+        return;
+    if (!force && pckpttimer.isValid() && pckpttimer.elapsed() < (qint64)AUTOSAVE_MINUTES * 60 * 1000)
+        return;
+    pckpt.progress = s48 + 1;
+    pckpt.seeds = seedmodel->getSeeds();
+    if (!saveCheckpoint(ckptpath, pckpt))
+        fprintf(stderr, "Failed to write checkpoint: %s\n", ckptpath.toLocal8Bit().data());
+    pckpttimer.start();
+}
+
 void MainWindow::removeCurrent()
 {
-    int row = ui->listResults->currentRow();
-    if (row >= 0)
-        ui->listResults->removeRow(row);
+    QModelIndex current = ui->listResults->currentIndex();
+    if (current.isValid())
+        seedmodel->removeSeed(current.row());
+}
+
+/* Checks the current results against the current conditions and keeps those
+ * that pass, which is much faster than repeating the search after a condition
+ * has been added.
+ */
+void MainWindow::refineResults()
+{
+    if (ui->buttonStart->isChecked() || sthread.isRunning() || psearch.isRunning())
+    {
+        warning("Warning", "Cannot refine results: search is still active.");
+        return;
+    }
+
+    int mc = MC_1_16;
+    getSeed(&mc, NULL);
+    QVector<Condition> condvec = getConditions();
+    if (condvec.empty())
+    {
+        warning("Warning", "Please define some constraints using the \"Add\" button.");
+        return;
+    }
+    if (seedmodel->rowCount() == 0 || !sthread.set(SEARCH_LIST, 0, MASK48, mc, condvec))
+        return;
+
+    procsearch = false;
+    refineseeds = seedmodel->getSeeds();
+    sthread.setSeedList(refineseeds);
+    seedmodel->clear();
+
+    ui->buttonStart->setChecked(true);
+    ui->comboSearchType->setEnabled(false);
+    ui->buttonStart->setText("Abort search");
+    ui->buttonStart->setIcon(QIcon::fromTheme("process-stop"));
+    ui->progressBar->setValue(0);
+    ui->progressBar->setFormat("0.00%");
+    sthread.start();
+    update();
 }
 
 void MainWindow::copyResults()
 {
     QString text;
-    int n = ui->listResults->rowCount();
-    for (int i = 0; i < n; i++)
-    {
-        int64_t seed = ui->listResults->item(i, 0)->data(Qt::UserRole).toLongLong();
+    for (int64_t seed : seedmodel->getSeeds())
         text += QString::asprintf("%" PRId64 "\n", seed);
-    }
 
     QClipboard *clipboard = QGuiApplication::clipboard();
     clipboard->setText(text);
@@ -846,26 +1091,28 @@ void MainWindow::pasteResults()
 int MainWindow::pasteList(bool dummy)
 {
     QClipboard *clipboard = QGuiApplication::clipboard();
-    QStringList slist = clipboard->text().split('\n');
-    QVector<int64_t> seeds;
+    SeedReader reader;
+    reader.setData(clipboard->text().toLatin1());
 
-    for (QString s : slist)
+    if (dummy)
     {
-        s = s.trimmed();
-        if (s.isEmpty())
-            continue;
-        bool ok = true;
-        int64_t seed = s.toLongLong(&ok);
-        if (!ok)
-            return 0;
-        seeds.push_back(seed);
+        // only counts, so the seeds need not be kept beyond each chunk
+        QVector<int64_t> seeds;
+        int n = 0;
+        while (!reader.atEnd())
+        {
+            seeds.clear();
+            int cnt = reader.readSeeds(&seeds, 1 << 18);
+            if (cnt <= 0)
+                return 0;
+            n += searchResultsAdd(seeds, true);
+        }
+        return n;
     }
 
-    if (!seeds.empty())
-    {
-        return searchResultsAdd(seeds, dummy);
-    }
-    return 0;
+    int n = seedmodel->rowCount();
+    loadSeedList(reader);
+    return seedmodel->rowCount() - n;
 }
 
 void MainWindow::copyCoord()
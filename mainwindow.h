@@ -3,7 +3,6 @@
 
 #include <QMainWindow>
 #include <QListWidgetItem>
-#include <QTableWidgetItem>
 #include <QWidget>
 
 #include <QTimer>
@@ -16,6 +15,8 @@
 
 #include "searchthread.h"
 #include "protobasedialog.h"
+#include "seedtablemodel.h"
+#include "processsearch.h"
 
 
 namespace Ui {
@@ -27,6 +28,7 @@ Q_DECLARE_METATYPE(Pos)
 Q_DECLARE_METATYPE(Condition)
 
 class MapView;
+class SeedReader;
 
 class MainWindow : public QMainWindow
 {
@@ -39,18 +41,22 @@ public:
     bool getSeed(int *mc, int64_t *seed, bool applyrand = true);
     bool setSeed(int mc, int64_t seed);
     QVector<Condition> getConditions() const;
+    int getSearchType() const;
+    void setSearchType(int searchtype);
     MapView *getMapView();
 
 protected:
     QListWidgetItem *lockItem(QListWidgetItem *item);
     void setItemCondition(QListWidget *list, QListWidgetItem *item, Condition cond);
     void editCondition(QListWidgetItem *item);
+    void updateConditionStats();
     void updateMapSeed();
     void updateSensitivity();
     int getIndex(int idx) const;
 
 public slots:
     void warning(QString title, QString text);
+    void information(QString title, QString text);
     void mapGoto(qreal x, qreal z);
     void openProtobaseMsg(QString path);
     void closeProtobaseMsg();
@@ -87,7 +93,6 @@ private slots:
     void on_buttonClear_clicked();
     void on_buttonStart_clicked();
 
-    void on_listResults_itemSelectionChanged();
     void on_listResults_customContextMenuRequested(const QPoint &pos);
 
     void on_buttonInfo_clicked();
@@ -98,6 +103,8 @@ private slots:
     void on_actionScan_seed_for_Quad_Huts_triggered();
     void on_actionOpen_shadow_seed_triggered();
     void on_actionAbout_triggered();
+    void on_actionSurvivorCache_toggled(bool enable);
+    void on_actionClearSurvivorCache_triggered();
 
     void on_mapView_customContextMenuRequested(const QPoint &pos);
 
@@ -107,19 +114,31 @@ private slots:
     void searchBaseDone(int64_t s48);
     void searchFinish(int64_t s48);
     void resultTimeout();
+    void resultCurrentChanged(const QModelIndex& current);
+    void pollSearch();
+    void saveProcessCheckpoint(int64_t s48, bool force);
     void removeCurrent();
+    void refineResults();
     void copyResults();
     void pasteResults();
     int pasteList(bool dummy = false);
+    bool loadSeedList(SeedReader& reader);
     void copyCoord();
 
 
 public:
     Ui::MainWindow *ui;
     SearchThread sthread;
+    ProcessSearch psearch;
+    bool procsearch;    // the current search runs in worker processes
     QTimer stimer;
+    SeedTableModel *seedmodel;
     ProtoBaseDialog *protodialog;
     QString prevdir;
+    QString ckptpath;   // checkpoint that searches keep updated
+    Checkpoint pckpt;   // checkpoint of a search in worker processes, kept here
+    QElapsedTimer pckpttimer;
+    QVector<int64_t> refineseeds; // results before a refinement, to restore on abort
 };
 
 #endif // MAINWINDOW_H
@@ -0,0 +1,169 @@
+#include "processsearch.h"
+#include "checkpoint.h"
+
+#include <QCoreApplication>
+#include <QDir>
+#include <QFile>
+
+
+// CPU lists of the NUMA nodes, in the format of taskset and numactl
+static QStringList numaCpuLists()
+{
+    QStringList lists;
+#ifdef __linux__
+    QDir dir("/sys/devices/system/node");
+    for (const QString& node : dir.entryList(QStringList() << "node*", QDir::Dirs, QDir::Name))
+    {
+        QFile file(dir.filePath(node + "/cpulist"));
+        if (!file.open(QIODevice::ReadOnly))
+            continue;
+        QString cpus = QString::fromLatin1(file.readAll()).trimmed();
+        if (!cpus.isEmpty())
+            lists.push_back(cpus);
+    }
+#endif
+    return lists;
+}
+
+ProcessSearch::ProcessSearch(QObject *parent)
+    : QObject(parent)
+    , ring(),key(),condpath(),cpulists(),cachedir(),procs(),restarts(),running(),failed()
+{
+}
+
+ProcessSearch::~ProcessSearch()
+{
+    stop();
+    for (QProcess *proc : procs)
+    {
+        if (!proc)
+            continue;
+        disconnect(proc, nullptr, this, nullptr);
+        if (!proc->waitForFinished(3000))
+            proc->kill();
+    }
+    if (!condpath.isEmpty())
+        QFile::remove(condpath);
+}
+
+bool ProcessSearch::start(int type, int64_t start48, int64_t end48, int mc, const QVector<Condition>& cv)
+{
+    if (isRunning())
+        return false;
+
+    cpulists = numaCpuLists();
+    if (cpulists.size() < 2)
+        cpulists.clear();
+    int n = cpulists.empty() ? 1 : cpulists.size();
+
+    key = QString::asprintf("cubiomes-viewer-%lld", (long long) QCoreApplication::applicationPid());
+    if (!ring.create(key, n, start48, end48))
+    {
+        g_searchhooks.message(MSG_WARN, "Warning", "Failed to create the shared memory for the worker processes.");
+        return false;
+    }
+
+    Checkpoint cp = { type, mc, start48, end48, cv, {}, QString(), 0 };
+    condpath = QDir(QDir::tempPath()).filePath(key + ".cvcp");
+    if (!saveCheckpoint(condpath, cp))
+    {
+        g_searchhooks.message(MSG_WARN, "Warning", "Failed to write the conditions for the worker processes.");
+        return false;
+    }
+
+    procs.fill(NULL, n);
+    restarts.fill(0, n);
+    running = 0;
+    failed = false;
+    for (int i = 0; i < n; i++)
+        startWorker(i);
+
+    if (running == 0)
+    {
+        QFile::remove(condpath);
+        return false;
+    }
+    return true;
+}
+
+void ProcessSearch::startWorker(int i)
+{
+    QString program = QCoreApplication::applicationDirPath() + "/cubiomes-cli";
+    QStringList args;
+    args << "--shm" << key << "--shm-index" << QString::number(i);
+    if (!cpulists.empty())
+        args << "--affinity" << cpulists[i];
+    if (cachedir.isEmpty())
+        args << "--no-cache";
+    else
+        args << "--cache" << cachedir;
+    args << condpath;
+
+    QProcess *proc = new QProcess(this);
+    proc->setProcessChannelMode(QProcess::ForwardedChannels);
+    connect(proc, QOverload<int, QProcess::ExitStatus>::of(&QProcess::finished), this,
+        [this, i](int exitcode, QProcess::ExitStatus status) { workerFinished(i, exitcode, status); });
+    proc->start(program, args);
+    if (!proc->waitForStarted())
+    {
+        delete proc;
+        failed = true;
+        g_searchhooks.message(MSG_WARN, "Warning", "Failed to start worker process:\n" + program);
+        return;
+    }
+    procs[i] = proc;
+    running++;
+}
+
+void ProcessSearch::workerFinished(int i, int exitcode, QProcess::ExitStatus status)
+{
+    procs[i]->deleteLater();
+    procs[i] = NULL;
+    running--;
+
+    // a worker that fails is restarted, and continues its unit from its progress
+    bool crashed = status != QProcess::NormalExit || exitcode != 0;
+    if (crashed && !ring.control()->abort && restarts[i] < PROCESS_RESTARTS)
+    {
+        restarts[i]++;
+        fprintf(stderr, "Worker process %d failed, restarting.\n", i);
+        startWorker(i);
+        if (procs[i])
+            return;
+    }
+    if (crashed)
+        failed = true;
+
+    if (running == 0)
+    {
+        QFile::remove(condpath);
+        if (failed && !ring.control()->abort)
+        {
+            g_searchhooks.message(MSG_WARN, "Warning",
+                    "A worker process failed repeatedly. The progress stops at the part of "
+                    "the search that it could not complete.");
+        }
+        emit finish(progress() + 1);
+    }
+}
+
+void ProcessSearch::stop()
+{
+    if (ring.isAttached())
+        ring.control()->abort = 1;
+}
+
+bool ProcessSearch::takeResults(QVector<int64_t>& seeds)
+{
+    if (!ring.isAttached())
+        return false;
+    int n = 0;
+    for (int i = 0; i < ring.control()->nrings; i++)
+        n += ring.drain(i, &seeds);
+    return n > 0;
+}
+
+int64_t ProcessSearch::progress()
+{
+    return ring.isAttached() ? ring.progress() : -1;
+}
@@ -0,0 +1,56 @@
+#ifndef PROCESSSEARCH_H
+#define PROCESSSEARCH_H
+
+#include "seedring.h"
+#include "search.h"
+
+#include <QObject>
+#include <QProcess>
+#include <QVector>
+#include <QStringList>
+
+#define PROCESS_RESTARTS 3
+
+/* Runs a search in worker processes (cubiomes-cli), so that a crash or an out
+ * of memory condition in a worker does not take down the viewer. The results
+ * and progress come through a shared memory ring for each worker. On Linux,
+ * one worker is started for each NUMA node and pinned to its CPUs.
+ */
+class ProcessSearch : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit ProcessSearch(QObject *parent = nullptr);
+    ~ProcessSearch();
+
+    bool start(int type, int64_t start48, int64_t end48, int mc, const QVector<Condition>& cv);
+    void stop();
+    bool isRunning() const { return running > 0; }
+    // directory of the 48-bit survivor cache for the workers, or empty for none
+    void setCacheDir(QString dir) { cachedir = dir; }
+
+    // Takes the results that are ready. Returns false if there were none.
+    bool takeResults(QVector<int64_t>& seeds);
+    // The last 48-bit seed for which all results are available.
+    int64_t progress();
+
+signals:
+    void finish(int64_t s48);
+
+protected:
+    void startWorker(int i);
+    void workerFinished(int i, int exitcode, QProcess::ExitStatus status);
+
+    SeedRing ring;
+    QString key;
+    QString condpath;       // checkpoint with the conditions for the workers
+    QStringList cpulists;   // CPUs of each worker, or empty
+    QString cachedir;
+    QVector<QProcess*> procs;
+    QVector<int> restarts;
+    int running;
+    bool failed;
+};
+
+#endif // PROCESSSEARCH_H
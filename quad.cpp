@@ -1,6 +1,7 @@
 #include "quad.h"
 
 #include "cutil.h"
+#include "search.h"
 
 #include <QThreadPool>
 
@@ -61,54 +62,53 @@ void Quad::run()
 
     if (pixs > 0)
     {
-        int *b = allocCache(entry, pixs, pixs);
+        int *b = borrowCache(entry, pixs, pixs);
 
         genArea(entry, b, ti*pixs, tj*pixs, pixs, pixs);
 
         rgb = new uchar[pixs*pixs * 3];
         biomesToImage(rgb, biomeColors, b, pixs, pixs, 1, 1);
         img = new QImage(rgb, pixs, pixs, QImage::Format_RGB888);
-        free(b);
+        returnScratch();
     }
     else
     {
-        LayerStack g;
-        setupGenerator(&g, mc);
+        LayerStack *g = getThreadGenerator(mc);
 
         switch (stype)
         {
         case D_DESERT:
-            spos = addStruct(mc <= MC_1_12 ? DESERT_PYRAMID_CONFIG_112 : DESERT_PYRAMID_CONFIG, &g);
+            spos = addStruct(mc <= MC_1_12 ? DESERT_PYRAMID_CONFIG_112 : DESERT_PYRAMID_CONFIG, g);
             break;
         case D_JUNGLE:
-            spos = addStruct(mc <= MC_1_12 ? JUNGLE_PYRAMID_CONFIG_112 : JUNGLE_PYRAMID_CONFIG, &g);
+            spos = addStruct(mc <= MC_1_12 ? JUNGLE_PYRAMID_CONFIG_112 : JUNGLE_PYRAMID_CONFIG, g);
             break;
         case D_IGLOO:
-            spos = addStruct(mc <= MC_1_12 ? IGLOO_CONFIG_112 : IGLOO_CONFIG, &g);
+            spos = addStruct(mc <= MC_1_12 ? IGLOO_CONFIG_112 : IGLOO_CONFIG, g);
             break;
         case D_HUT:
-            spos = addStruct(mc <= MC_1_12 ? SWAMP_HUT_CONFIG_112 : SWAMP_HUT_CONFIG, &g);
+            spos = addStruct(mc <= MC_1_12 ? SWAMP_HUT_CONFIG_112 : SWAMP_HUT_CONFIG, g);
             break;
         case D_VILLAGE:
-            spos = addStruct(VILLAGE_CONFIG, &g);
+            spos = addStruct(VILLAGE_CONFIG, g);
             break;
         case D_MANSION:
-            spos = addStruct(MANSION_CONFIG, &g);
+            spos = addStruct(MANSION_CONFIG, g);
             break;
         case D_MONUMENT:
-            spos = addStruct(MONUMENT_CONFIG, &g);
+            spos = addStruct(MONUMENT_CONFIG, g);
             break;
         case D_RUINS:
-            spos = addStruct(mc <= MC_1_15 ? OCEAN_RUIN_CONFIG_115 : OCEAN_RUIN_CONFIG, &g);
+            spos = addStruct(mc <= MC_1_15 ? OCEAN_RUIN_CONFIG_115 : OCEAN_RUIN_CONFIG, g);
             break;
         case D_SHIPWRECK:
-            spos = addStruct(mc <= MC_1_15 ? SHIPWRECK_CONFIG_115 : SHIPWRECK_CONFIG, &g);
+            spos = addStruct(mc <= MC_1_15 ? SHIPWRECK_CONFIG_115 : SHIPWRECK_CONFIG, g);
             break;
         case D_OUTPOST:
-            spos = addStruct(OUTPOST_CONFIG, &g);
+            spos = addStruct(OUTPOST_CONFIG, g);
             break;
         case D_PORTAL:
-            spos = addStruct(RUINED_PORTAL_CONFIG, &g);
+            spos = addStruct(RUINED_PORTAL_CONFIG, g);
             break;
         }
     }
@@ -137,7 +137,7 @@ int mapOceanMixMod(const Layer * l, int * out, int x, int z, int w, int h)
     int i, j;
     l->p2->getMap(l->p2, out, x, z, w, h);
 
-    otyp = (int *) malloc(w*h*sizeof(int));
+    otyp = borrowScratch(w*h);
     memcpy(otyp, out, w*h*sizeof(int));
 
     l->p->getMap(l->p, out, x, z, w, h);
@@ -179,7 +179,7 @@ int mapOceanMixMod(const Layer * l, int * out, int x, int z, int w, int h)
         }
     }
 
-    free(otyp);
+    returnScratch();
 
     return 0;
 }
@@ -472,12 +472,11 @@ struct SpawnStronghold : public QRunnable
 
     void run()
     {
-        LayerStack g;
-        setupGenerator(&g, mc);
-        applySeed(&g, seed);
+        LayerStack *g = getThreadGenerator(mc);
+        applySeed(g, seed);
 
         Pos *p = new Pos;
-        *p = getSpawn(mc, &g, NULL, seed);
+        *p = getSpawn(mc, g, NULL, seed);
         world->spawn = p;
         if (world->isdel) return;
 
@@ -487,7 +486,7 @@ struct SpawnStronghold : public QRunnable
         std::vector<Pos> *shp = new std::vector<Pos>;
         shp->reserve(mc >= MC_1_9 ? 128 : 3);
 
-        while (nextStronghold(&sh, &g, NULL) > 0)
+        while (nextStronghold(&sh, g, NULL) > 0)
         {
             if (world->isdel)
             {
@@ -1,9 +1,17 @@
 #include "search.h"
-#include "mainwindow.h"
 
 #include <QThread>
+#include <QMutex>
+#include <QMap>
+
+#include <vector>
+#include <deque>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
 
 #include <unistd.h>
+#include <x86intrin.h>
 
 #if defined(_WIN32)
 #include <direct.h>
@@ -12,7 +20,19 @@
 #include <sys/stat.h>
 #endif
 
-extern MainWindow *gMainWindowInstance;
+static void logMessage(int level, QString title, QString text)
+{
+    fprintf(stderr, "%s: %s\n", level == MSG_WARN ? "Warning" : "Info",
+            (title + " - " + text).toLocal8Bit().data());
+}
+
+static void logProtobaseOpen(QString path)
+{
+    fprintf(stderr, "Generating protobases, results will be saved to \"%s\"\n",
+            path.toLocal8Bit().data());
+}
+
+SearchHooks g_searchhooks = { logMessage, logProtobaseOpen, NULL };
 
 // Quad monument bases are too expensive to generate on the fly and there are
 // so few of them that they can be hard coded, rather than loading from a file.
@@ -304,6 +324,11 @@ int check(int64_t s48, void *data)
     return isQuadBase(sconf, s48 - sconf.salt, 128);
 }
 
+// Seed bases that have been loaded from the protobase files, by file and salt.
+// They are kept for the lifetime of the process, so later searches start warm.
+static QMutex g_basemutex;
+static QMap<QString, std::vector<int64_t>> g_basecache;
+
 /* Loads a seed list for a filter type from disk, or generates it if neccessary.
  * @mc      mincreaft version
  * @ftyp    filter type
@@ -351,34 +376,44 @@ static void genSeedBases(int mc, int ftyp, const int64_t **qb, int64_t *qbn,
 L_QH_ANY:
         snprintf(fnam, sizeof(fnam), "protobases/quad_%s.txt", lbstr);
         *sconf = mc <= MC_1_12 ? SWAMP_HUT_CONFIG_112 : SWAMP_HUT_CONFIG;
-
-        if ((dqb = loadSavedSeeds(fnam, qbn)) == NULL)
         {
-            QMetaObject::invokeMethod(gMainWindowInstance, "openProtobaseMsg", Qt::QueuedConnection, Q_ARG(QString, QString(fnam)));
+            QMutexLocker locker(&g_basemutex);
+            std::vector<int64_t>& cached = g_basecache[QString::asprintf("%s:%d", fnam, sconf->salt)];
+            if (!cached.empty())
+            {
+                *qb = cached.data();
+                *qbn = cached.size();
+                break;
+            }
 
-            int threads = QThread::idealThreadCount();
-            int err = searchAll48(&dqb, qbn, fnam, threads, lbset, lbcnt, 20, check, sconf);
+            if ((dqb = loadSavedSeeds(fnam, qbn)) == NULL)
+            {
+                if (g_searchhooks.protobaseOpen)
+                    g_searchhooks.protobaseOpen(fnam);
 
-            QMetaObject::invokeMethod(gMainWindowInstance, "closeProtobaseMsg", Qt::BlockingQueuedConnection);
+                int threads = QThread::idealThreadCount();
+                int err = searchAll48(&dqb, qbn, fnam, threads, lbset, lbcnt, 20, check, sconf);
 
-            if (err)
+                if (g_searchhooks.protobaseClose)
+                    g_searchhooks.protobaseClose();
+
+                if (err)
+                {
+                    g_searchhooks.message(MSG_WARN, "Warning", "Failed to generate protobases.");
+                    return;
+                }
+            }
+            if (dqb)
             {
-                QMetaObject::invokeMethod(
-                        gMainWindowInstance, "warning", Qt::BlockingQueuedConnection,
-                        Q_ARG(QString, QString("Warning")),
-                        Q_ARG(QString, QString("Failed to generate protobases.")));
-                return;
+                // convert protobases to proper bases by subtracting the salt
+                cached.resize(*qbn);
+                for (int64_t i = 0; i < (*qbn); i++)
+                    cached[i] = dqb[i] - sconf->salt;
+                free(dqb);
+                *qb = cached.data();
             }
+            break;
         }
-        if (dqb)
-        {
-            // convert protobases to proper bases by subtracting the salt
-            for (int64_t i = 0; i < (*qbn); i++)
-                dqb[i] -= sconf->salt;
-            *qb = (const int64_t*)dqb;
-            *dyn = 1;
-        }
-        break;
 
     case F_QM_95:
         *qb = g_qm_95;
@@ -395,23 +430,72 @@ L_QH_ANY:
     }
 }
 
-static int cmp_baseitem(const void *a, const void *b)
+// seed of position j in a cell run
+static inline int64_t runSeed(const CandidateSource *src, const CandidateRun *run, int64_t j)
 {
-    return *(int64_t*)a > *(int64_t*)b;
+    int64_t n = src->bases.size();
+    int64_t i = run->i0 + j;
+    if (i >= n)
+        i -= n;
+    return (src->bases[i] + run->off) & MASK48;
 }
 
-/* Produces a list of seed bases from precomputed lists, provided all candidates
- * fit into a buffer.
- *
- * @param mc        mincraft version
- * @param cond      conditions
- * @param ccnt      number of conditions
- * @param bufmax    maximum allowed buffer size
- */
-CandidateList getCandidates(int mc, const Condition *cond, int ccnt, int64_t bufmax)
+// positions a run at its first seed >= target, returns false when exhausted
+static bool seekRun(const CandidateSource *src, CandidateRun *run, int64_t target)
+{
+    int64_t lo = run->j, hi = src->bases.size();
+    // the runs mostly advance by the seed that was just taken, so the next
+    // seed is tried first and only a gap is searched for
+    if (lo < hi && runSeed(src, run, lo) < target)
+        lo++;
+    if (lo < hi && runSeed(src, run, lo) < target)
+    {
+        lo++;
+        while (lo < hi)
+        {
+            int64_t mid = lo + (hi - lo) / 2;
+            if (runSeed(src, run, mid) < target)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+    }
+    run->j = lo;
+    if (lo >= (int64_t)src->bases.size())
+        return false;
+    run->seed = runSeed(src, run, lo);
+    return true;
+}
+
+static bool cmp_run(const CandidateRun& a, const CandidateRun& b)
+{
+    return a.seed > b.seed;
+}
+
+// drops seeds below target from all runs of the source
+static void skipSource(CandidateSource *src, int64_t target)
+{
+    std::vector<CandidateRun>& heap = src->heap;
+    while (!heap.empty() && heap.front().seed < target)
+    {
+        std::pop_heap(heap.begin(), heap.end(), cmp_run);
+        if (seekRun(src, &heap.back(), target))
+            std::push_heap(heap.begin(), heap.end(), cmp_run);
+        else
+            heap.pop_back();
+    }
+}
+
+bool initCandidates(CandidateStream *cs, int mc, const Condition *cond, int ccnt,
+        int64_t start, int64_t bufmax)
 {
     int ci;
-    CandidateList clist = {};
+
+    cs->src.clear();
+    cs->conf.clear();
+    cs->next = start;
+    cs->cur.seed = 0;
+    cs->cur.spos.clear();
 
     for (ci = 0; ci < ccnt; ci++)
     {
@@ -420,80 +504,159 @@ CandidateList getCandidates(int mc, const Condition *cond, int ccnt, int64_t buf
         StructureConfig sconf;
         int dyn;
 
-        if (cond[ci].relative == 0)
+        if (cond[ci].relative != 0)
+            continue;
+
+        int x = cond[ci].x1;
+        int z = cond[ci].z1;
+        int w = cond[ci].x2 - x + 1;
+        int h = cond[ci].z2 - z + 1;
+
+        // only the cell runs are kept in memory, does this condition fit?
+        if (w*(int64_t)h * (int64_t)sizeof(CandidateRun) >= bufmax)
+            continue;
+
+        genSeedBases(mc, cond[ci].type, &qb, &qbn, &dyn, &sconf);
+        if (!qb)
+            continue;
+        if (qbn > UINT32_MAX)
         {
-            genSeedBases(mc, cond[ci].type, &qb, &qbn, &dyn, &sconf);
+            if (dyn)
+                free((void*)qb);
+            continue;
+        }
 
-            if (qb)
+        int cfg;
+        for (cfg = 0; cfg < (int)cs->conf.size(); cfg++)
+            if (!memcmp(&cs->conf[cfg], &sconf, sizeof(sconf)))
+                break;
+        if (cfg == (int)cs->conf.size())
+            cs->conf.push_back(sconf);
+
+        cs->src.emplace_back();
+        CandidateSource *src = &cs->src.back();
+        src->cfg = cfg;
+        src->save = cond[ci].save;
+        src->type = cond[ci].type;
+        src->bases.resize(qbn);
+        for (int64_t q = 0; q < qbn; q++)
+            src->bases[q] = qb[q] & MASK48;
+        std::sort(src->bases.begin(), src->bases.end());
+        src->bases.erase(std::unique(src->bases.begin(), src->bases.end()), src->bases.end());
+        if (dyn)
+            free((void*)qb);
+
+        src->heap.reserve(w*h);
+        for (int j = 0; j < h; j++)
+        {
+            for (int i = 0; i < w; i++)
             {
-                int x = cond[ci].x1;
-                int z = cond[ci].z1;
-                int w = cond[ci].x2 - x + 1;
-                int h = cond[ci].z2 - z + 1;
-
-                // does the set of candidates for this condition fit in memory?
-                if (qbn * w*h * 4 * (int64_t)sizeof(*clist.items->spos) < bufmax)
-                {
-                    if (clist.items == NULL)
-                    {
-                        clist.bcnt = qbn * w*h;
-                        clist.scnt = 4;
-                        clist.isiz = sizeof(*clist.items) + clist.scnt * sizeof(*clist.items->spos);
-                        clist.mem = (char*) calloc(clist.bcnt, clist.isiz);
-                        if (!clist.mem)
-                        {
-                            if (dyn)
-                                free((void*)qb);
-                            break;
-                        }
+                CandidateRun run;
+                run.x = x+i;
+                run.z = z+j;
+                run.off = moveStructure(0, x+i, z+j);
+                // the bases that overflow with the offset wrap around to the
+                // lowest seeds of the run
+                run.i0 = std::lower_bound(src->bases.begin(), src->bases.end(),
+                        (MASK48+1 - run.off) & MASK48) - src->bases.begin();
+                if (run.off == 0 || run.i0 == src->bases.size())
+                    run.i0 = 0;
+                run.j = 0;
+                if (seekRun(src, &run, start))
+                    src->heap.push_back(run);
+            }
+        }
+        std::make_heap(src->heap.begin(), src->heap.end(), cmp_run);
+    }
 
-                        Candidate *item = (Candidate*)(clist.mem);
+    return !cs->src.empty();
+}
 
-                        int i, j;
-                        int64_t q;
-                        for (j = 0; j < h; j++)
-                        {
-                            for (i = 0; i < w; i++)
-                            {
-                                for (q = 0; q < qbn; q++)
-                                {
-                                    item->seed = moveStructure(qb[q], x+i, z+j);
-                                    item->spos[0].sconf = sconf;
-                                    item->spos[0].x = x+i;
-                                    item->spos[0].z = z+j;
-                                    item->spos[1].sconf = sconf;
-                                    item->spos[1].x = x+i+1;
-                                    item->spos[1].z = z+j;
-                                    item->spos[2].sconf = sconf;
-                                    item->spos[2].x = x+i;
-                                    item->spos[2].z = z+j+1;
-                                    item->spos[3].sconf = sconf;
-                                    item->spos[3].x = x+i+1;
-                                    item->spos[3].z = z+j+1;
-                                    item = (Candidate*)((char*)item + clist.isiz);
-                                }
-                            }
-                        }
-                    }
-                    else
-                    {
-                        // TODO:
-                        // merge, i.e. filter out seeds and add new structure condition to item->spos
-                    }
-                }
+bool nextCandidate(CandidateStream *cs)
+{
+    int64_t target = cs->next;
+    size_t i, n = cs->src.size();
 
-                if (dyn)
-                    free((void*)qb);
-            }
+    // leapfrog intersection of the sources
+L_RETRY:
+    if (target > MASK48)
+        return false;
+    for (i = 0; i < n; i++)
+    {
+        CandidateSource *src = &cs->src[i];
+        skipSource(src, target);
+        if (src->heap.empty())
+            return false;
+        if (src->heap.front().seed > target)
+        {
+            target = src->heap.front().seed;
+            goto L_RETRY;
         }
     }
 
-    if (clist.items)
+    cs->cur.seed = target;
+    cs->cur.spos.clear();
+    for (i = 0; i < n; i++)
+    {
+        const CandidateSource *src = &cs->src[i];
+        const CandidateRun& run = src->heap.front();
+        cs->cur.spos.push_back({(int16_t)src->cfg, (int16_t)src->save, run.x, run.z});
+    }
+    cs->next = target + 1;
+    return true;
+}
+
+
+// does the 2x2 structure group at region cell (x,z) pass, as in testCond()?
+static bool testQuadCell(int type, const StructureConfig& sconf, int64_t seed, int x, int z)
+{
+    int64_t s = moveStructure(seed, -x, -z);
+    switch (type)
     {
-        qsort(clist.items, clist.bcnt, clist.isiz, cmp_baseitem);
+    case F_QH_IDEAL:
+    case F_QH_CLASSIC:
+    case F_QH_NORMAL:
+    case F_QH_BARELY:
+        return qhutQual((s + sconf.salt) & 0xfffff) >= type &&
+                isQuadBaseFeature24(sconf, s, 7,7,9);
+    case F_QM_95:
+        return qmonumentQual(s) >= 58*58*4 * 95 / 100;
+    case F_QM_90:
+        return qmonumentQual(s) >= 58*58*4 * 90 / 100;
+    default:
+        return false;
     }
+}
 
-    return clist;
+void getCandidatePos(const CandidateStream *cs, StructPos *spos, bool *known)
+{
+    for (size_t i = 0; i < cs->cur.spos.size(); i++)
+    {
+        const Candidate::SPos& sp = cs->cur.spos[i];
+        const StructureConfig& sconf = cs->conf[sp.cfg];
+        int64_t seed = cs->cur.seed;
+        int type = cs->src[i].type;
+        Pos p[4], pc;
+
+        // the seed bases may be looser than the condition, which is then
+        // left to testCond()
+        if (!testQuadCell(type, sconf, seed, sp.x, sp.z))
+            continue;
+        p[0] = getStructurePos(sconf, seed, sp.x+0, sp.z+0, 0);
+        p[1] = getStructurePos(sconf, seed, sp.x+0, sp.z+1, 0);
+        p[2] = getStructurePos(sconf, seed, sp.x+1, sp.z+0, 0);
+        p[3] = getStructurePos(sconf, seed, sp.x+1, sp.z+1, 0);
+        // the same AFK spot as in testCond()
+        if (type == F_QM_95 || type == F_QM_90)
+            pc = getOptimalAfk(p, 58,23,58, 0);
+        else
+            pc = getOptimalAfk(p, 7,7,9, 0);
+        StructPos *sout = spos + sp.save;
+        sout->sconf = sconf;
+        sout->cx = pc.x;
+        sout->cz = pc.z;
+        known[sp.save] = true;
+    }
 }
 
 
@@ -550,6 +713,500 @@ static bool isInnerRingOk(int mc, int64_t seed, int x1, int z1, int x2, int z2,
     return false;
 }
 
+/* Gets the structure configuration of a single structure filter type.
+ * Returns false if the type is not one of these filters.
+ */
+static bool getFilterStructConfig(int type, int mc, StructureConfig *sconf)
+{
+    switch (type)
+    {
+    case F_DESERT:
+        *sconf = mc <= MC_1_12 ? DESERT_PYRAMID_CONFIG_112 : DESERT_PYRAMID_CONFIG;
+        return true;
+    case F_HUT:
+        *sconf = mc <= MC_1_12 ? SWAMP_HUT_CONFIG_112 : SWAMP_HUT_CONFIG;
+        return true;
+    case F_JUNGLE:
+        *sconf = mc <= MC_1_12 ? JUNGLE_PYRAMID_CONFIG_112 : JUNGLE_PYRAMID_CONFIG;
+        return true;
+    case F_IGLOO:
+        *sconf = mc <= MC_1_12 ? IGLOO_CONFIG_112 : IGLOO_CONFIG;
+        return true;
+    case F_MONUMENT:    *sconf = MONUMENT_CONFIG;   return true;
+    case F_VILLAGE:     *sconf = VILLAGE_CONFIG;    return true;
+    case F_OUTPOST:     *sconf = OUTPOST_CONFIG;    return true;
+    case F_MANSION:     *sconf = MANSION_CONFIG;    return true;
+    default:
+        return false;
+    }
+}
+
+/* Rough estimate of the work done by a condition in the full seed stage, in
+ * arbitrary units, together with the fraction of seeds that pass it.
+ */
+static void estimateCondCost(const Condition *c, int mc, double *cost, double *pass)
+{
+    const FilterInfo& finfo = g_filterinfo.list[c->type];
+    double w = c->x2 - c->x1 + 1;
+    double h = c->z2 - c->z1 + 1;
+    double area = w * h;
+    StructureConfig sconf;
+
+    if (finfo.cat == CAT_48)
+    {
+        // the remaining 48-bit checks are cheap and usually rare
+        *cost = 1;
+        *pass = 0.01;
+        return;
+    }
+
+    switch (c->type)
+    {
+    case F_BIOME:           *cost = 50 + 16 * area; break;
+    case F_BIOME_4_RIVER:   *cost = 50 +  8 * area; break;
+    case F_BIOME_16_SHORE:  *cost = 50 +  6 * area; break;
+    case F_BIOME_64_RARE:   *cost = 50 +  4 * area; break;
+    case F_BIOME_256_BIOME: *cost = 50 +  2 * area; break;
+    case F_TEMPS:           *cost = 20 +  1 * area; break;
+    case F_SPAWN:           *cost = 5000;           break;
+    case F_STRONGHOLD:      *cost = 2000;           break;
+    default:
+        if (getFilterStructConfig(c->type, mc, &sconf))
+        {
+            // each attempt inside the area has its biome viability checked
+            double rs = sconf.regionSize * 16.0;
+            double attempts = (w / rs + 1) * (h / rs + 1);
+            *cost = 10 + 40 * attempts;
+        }
+        else
+        {
+            *cost = 1;
+        }
+        break;
+    }
+
+    switch (c->type)
+    {
+    case F_BIOME:
+    case F_BIOME_4_RIVER:
+    case F_BIOME_16_SHORE:
+    case F_BIOME_64_RARE:
+    case F_BIOME_256_BIOME:
+        // each required biome halves the chances, exclusions cut a bit more
+        *pass = pow(0.5, c->count) * ((c->exclb || c->exclm) ? 0.7 : 1.0);
+        break;
+    case F_TEMPS:
+        *pass = pow(0.3, c->count);
+        break;
+    case F_SPAWN:
+        // spawn is roughly spread over a few hundred blocks
+        *pass = area / (512.0 * 512.0);
+        break;
+    case F_STRONGHOLD:
+        *pass = 0.5;
+        break;
+    default:
+        *pass = pow(0.5, c->count);
+        break;
+    }
+    if (*pass > 0.99)
+        *pass = 0.99;
+}
+
+bool planConditions(Condition *cond, int ccnt, int mc)
+{
+    std::vector<Condition> plan;
+    std::vector<double> rank(ccnt);
+    std::vector<bool> placed(ccnt);
+    bool avail[100] = {};
+
+    for (int i = 0; i < ccnt; i++)
+    {
+        double cost, pass;
+        estimateCondCost(cond + i, mc, &cost, &pass);
+        // expected work per rejected seed, which is the classic order for
+        // independent filters
+        rank[i] = cost / (1.0 - pass);
+    }
+
+    while ((int)plan.size() < ccnt)
+    {
+        int best = -1;
+        for (int i = 0; i < ccnt; i++)
+        {
+            if (placed[i])
+                continue;
+            if (cond[i].relative && !avail[cond[i].relative])
+                continue;
+            if (best >= 0)
+            {
+                bool full = g_filterinfo.list[cond[i].type].cat != CAT_48;
+                bool bestfull = g_filterinfo.list[cond[best].type].cat != CAT_48;
+                if (full > bestfull)
+                    continue;
+                if (full == bestfull && rank[i] >= rank[best])
+                    continue;
+            }
+            best = i;
+        }
+        if (best < 0)
+            return false;
+
+        placed[best] = true;
+        avail[cond[best].save] = true;
+        plan.push_back(cond[best]);
+    }
+
+    std::copy(plan.begin(), plan.end(), cond);
+    return true;
+}
+
+// the scratch buffers of a thread, of which the first t_scratchtop are borrowed
+static thread_local std::vector<std::vector<int>> t_scratch;
+static thread_local size_t t_scratchtop = 0;
+
+int *borrowScratch(size_t n)
+{
+    if (t_scratchtop == t_scratch.size())
+        t_scratch.emplace_back();
+    std::vector<int>& buf = t_scratch[t_scratchtop++];
+    if (buf.size() < n)
+        buf.resize(n);
+    return buf.data();
+}
+
+void returnScratch()
+{
+    t_scratchtop--;
+}
+
+#define MEMO_MAXCELLS (1 << 16)
+
+// The last area that was generated on a layer, for the seed of the memo.
+struct LayerMemoEntry
+{
+    mapfunc_t *getMap;      // map function of the layer, or NULL if not memoised
+    int64_t seed;
+    int64_t startSeed;      // of the layer, which changes with any other seed
+    int x, z, w, h;
+    std::vector<int> ids;
+};
+
+/* Areas of the layers that several conditions of one seed tend to request,
+ * such as a biome filter, the spawn and the structure viability, which all go
+ * through the 1:4 layers. Requests that lie within the last area of a layer
+ * are copied from it, rather than generated again.
+ */
+struct LayerMemo
+{
+    int64_t seed;           // seed that is evaluated, see setMemoSeed()
+    LayerMemoEntry ent[L_NUM];
+};
+
+struct GenSlot
+{
+    int mc;
+    LayerStack g;
+    LayerMemo memo;
+};
+
+// One slot per version that the thread has used. A generator that is handed
+// out stays valid, as the slots are never reused for another version and the
+// deque does not move them when it grows.
+static thread_local std::deque<GenSlot> t_genslots;
+
+static int mapMemo(const Layer *l, int *out, int x, int z, int w, int h)
+{
+    // the entry holds the original map function, which does not change
+    LayerMemoEntry *e = (LayerMemoEntry*) l->data;
+
+    GenSlot *slot = NULL;
+    for (size_t i = 0; i < t_genslots.size() && !slot; i++)
+        if (l >= t_genslots[i].g.layers && l < t_genslots[i].g.layers + L_NUM)
+            slot = &t_genslots[i];
+    // a generator of another thread, or a copy, is generated without the memo
+    if (!slot || e != &slot->memo.ent[l - slot->g.layers])
+        return e->getMap(l, out, x, z, w, h);
+
+    LayerMemo *memo = &slot->memo;
+    if (e->seed == memo->seed && e->startSeed == l->startSeed &&
+        x >= e->x && z >= e->z && x+w <= e->x+e->w && z+h <= e->z+e->h)
+    {
+        for (int j = 0; j < h; j++)
+            memcpy(out + j*w, &e->ids[(z - e->z + j) * e->w + (x - e->x)], w * sizeof(int));
+        return 0;
+    }
+
+    int err = e->getMap(l, out, x, z, w, h);
+    if (!err && w*h <= MEMO_MAXCELLS)
+    {
+        e->seed = memo->seed;
+        e->startSeed = l->startSeed;
+        e->x = x;
+        e->z = z;
+        e->w = w;
+        e->h = h;
+        e->ids.assign(out, out + w*h);
+    }
+    return err;
+}
+
+static void setupMemo(GenSlot *slot)
+{
+    // The ocean mix layer is left alone, since cubiomes recognises it by
+    // its map function when it sizes the buffers.
+    static const int memolayers[] = {
+        L_BIOME_256, L_RARE_BIOME_64, L_SHORE_16, L_RIVER_MIX_4
+    };
+    LayerMemo *memo = &slot->memo;
+    memo->seed = 0;
+    for (int i = 0; i < L_NUM; i++)
+    {
+        memo->ent[i].getMap = NULL;
+        memo->ent[i].w = memo->ent[i].h = 0;
+    }
+    for (int id : memolayers)
+    {
+        // the entry is kept on the layer, in place of its unused data
+        Layer *l = &slot->g.layers[id];
+        if (!l->getMap || l->data)
+            continue;
+        memo->ent[id].getMap = l->getMap;
+        l->getMap = mapMemo;
+        l->data = &memo->ent[id];
+    }
+}
+
+/* Sets the seed that the thread generator is used for. The memoised areas of
+ * another seed are not used after this.
+ */
+static void setMemoSeed(LayerStack *g, int64_t seed)
+{
+    for (size_t i = 0; i < t_genslots.size(); i++)
+        if (&t_genslots[i].g == g)
+            t_genslots[i].memo.seed = seed;
+}
+
+LayerStack *getThreadGenerator(int mc)
+{
+    for (size_t i = 0; i < t_genslots.size(); i++)
+        if (t_genslots[i].mc == mc)
+            return &t_genslots[i].g;
+
+    t_genslots.emplace_back();
+    GenSlot *slot = &t_genslots.back();
+    slot->mc = mc;
+    setupGenerator(&slot->g, mc);
+    setupMemo(slot);
+    return &slot->g;
+}
+
+#define BIOME_TILESIZ 64
+
+// does the filter require any biomes?
+static bool hasBiomeFilter(const BiomeFilter& bf)
+{
+    return (bf.tempsToFind | bf.otempToFind | bf.majorToFind | bf.edgesToFind |
+            bf.raresToFind | bf.raresToFindM | bf.shoreToFind | bf.shoreToFindM |
+            bf.riverToFind | bf.riverToFindM | bf.oceanToFind) || bf.specialCnt;
+}
+
+static inline bool isExcluded(int id, uint64_t exclb, uint64_t exclm)
+{
+    return id < 128 ? (exclb >> id) & 1 : (exclm >> (id-128)) & 1;
+}
+
+/* Checks an area of a biome layer for excluded biomes in tiles, and stops at
+ * the first one. The tiles are visited coarse to fine, as in a quadtree, so a
+ * biome that covers much of the area tends to be found after a few tiles.
+ */
+static int checkExclusions(LayerStack *g, int layer, int64_t seed, int x, int z, int w, int h,
+        uint64_t exclb, uint64_t exclm, volatile bool *abort)
+{
+    if (!exclb && !exclm)
+        return 1;
+
+    const Layer *l = &g->layers[layer];
+    int tw = (w + BIOME_TILESIZ-1) / BIOME_TILESIZ;
+    int th = (h + BIOME_TILESIZ-1) / BIOME_TILESIZ;
+    int top = 1;
+    while (top < tw || top < th)
+        top <<= 1;
+
+    int *tile = borrowCache(l, BIOME_TILESIZ, BIOME_TILESIZ);
+    applySeed(g, seed);
+
+    int ok = 1;
+    for (int step = top; step > 0 && ok; step >>= 1)
+    {
+        for (int tj = 0; tj < th && ok; tj += step)
+        {
+            for (int ti = 0; ti < tw && ok; ti += step)
+            {
+                // tiles on the grid of the previous step are done
+                if (step < top && (ti & step) == 0 && (tj & step) == 0)
+                    continue;
+                if (*abort)
+                {
+                    ok = 0;
+                    break;
+                }
+                int tx = x + ti * BIOME_TILESIZ;
+                int tz = z + tj * BIOME_TILESIZ;
+                int sw = std::min(BIOME_TILESIZ, x + w - tx);
+                int sh = std::min(BIOME_TILESIZ, z + h - tz);
+                genArea(l, tile, tx, tz, sw, sh);
+                for (int i = 0; i < sw*sh; i++)
+                {
+                    if (isExcluded(tile[i], exclb, exclm))
+                    {
+                        ok = 0;
+                        break;
+                    }
+                }
+            }
+        }
+    }
+    returnScratch();
+    return ok;
+}
+
+// The biomes that each biome of a layer can still turn into, for a version.
+struct BiomePotential
+{
+    int mc, layer;
+    uint64_t mL[256], mM[256];
+};
+
+static const BiomePotential *getThreadPotential(int mc, int layer)
+{
+    thread_local BiomePotential pots[4];
+    thread_local int potcnt = 0;
+    thread_local int potnext = 0;
+
+    for (int i = 0; i < potcnt; i++)
+        if (pots[i].mc == mc && pots[i].layer == layer)
+            return &pots[i];
+
+    BiomePotential *pot;
+    if (potcnt < 4)
+    {
+        pot = &pots[potcnt++];
+    }
+    else
+    {
+        pot = &pots[potnext];
+        potnext = (potnext + 1) % 4;
+    }
+    pot->mc = mc;
+    pot->layer = layer;
+    for (int id = 0; id < 256; id++)
+    {
+        pot->mL[id] = pot->mM[id] = 0;
+        genPotential(&pot->mL[id], &pot->mM[id], layer, mc, id);
+    }
+    return pot;
+}
+
+/* A necessary condition for a biome filter on a fine layer: each required
+ * biome (or with 'any', one of them) has to be able to generate from one of
+ * the biomes in the area on a coarse layer. The coarse area is widened by a
+ * margin (in cells of scale 1:2^cs), as the zoom, edge and mixing layers
+ * spread biomes a little. The block area is [x1,x2] x [z1,z2].
+ */
+static int checkPotential(LayerStack *g, int mc, int layer, int cs, int margin, int64_t seed,
+        int x1, int z1, int x2, int z2, uint64_t reqL, uint64_t reqM, int any = 0)
+{
+    const BiomePotential *pot = getThreadPotential(mc, layer);
+    const Layer *l = &g->layers[layer];
+    int cx = (x1 >> cs) - margin;
+    int cz = (z1 >> cs) - margin;
+    int w = (x2 >> cs) + margin - cx + 1;
+    int h = (z2 >> cs) + margin - cz + 1;
+
+    int *area = borrowCache(l, w, h);
+    applySeed(g, seed);
+    genArea(l, area, cx, cz, w, h);
+
+    uint64_t mL = 0, mM = 0;
+    int ok = 0;
+    for (int i = 0; i < w*h && !ok; i++)
+    {
+        int id = area[i];
+        if (id < 0 || id >= 256)
+        {
+            mL = mM = ~0ULL;
+        }
+        else
+        {
+            mL |= pot->mL[id];
+            mM |= pot->mM[id];
+        }
+        if (any)
+            ok = (reqL & mL) || (reqM & mM);
+        else
+            ok = (reqL & ~mL) == 0 && (reqM & ~mM) == 0;
+    }
+    returnScratch();
+    return ok;
+}
+
+#define SPAWN_RANGE     256 // blocks around the origin of the spawn biome search
+#define SPAWN_MARGIN    320 // spiral over +-16 chunks in 1.13+, with some slack
+
+/* Rules out that the spawn of 1.13+ lies in the block area [x1,x2] x [z1,z2],
+ * from the biomes alone. The spawn starts on a random cell of a spawn biome
+ * within SPAWN_RANGE of the origin, or at the origin if there is none, and is
+ * then moved by less than SPAWN_MARGIN blocks. So a spawn biome has to be able
+ * to generate on a cell of the search that is close enough to the area.
+ * Returns 0 if the spawn cannot be in the area.
+ */
+static int isSpawnPlausible(LayerStack *g, int mc, int64_t seed, int x1, int z1, int x2, int z2)
+{
+    static const int spawnbiomes[] = {
+        forest, plains, taiga, taiga_hills, wooded_hills, jungle, jungle_hills
+    };
+    if (mc < MC_1_13)
+        return 1; // the older spawn search walks around without a bound
+    if (x1 - SPAWN_MARGIN <= 16 && x2 + SPAWN_MARGIN >= 0 &&
+        z1 - SPAWN_MARGIN <= 16 && z2 + SPAWN_MARGIN >= 0)
+        return 1; // close to the origin, where the spawn is without spawn biomes
+
+    // 1:4 cells of the biome search that are close enough to the area
+    int cx1 = std::max(x1 - SPAWN_MARGIN, -SPAWN_RANGE) >> 2;
+    int cz1 = std::max(z1 - SPAWN_MARGIN, -SPAWN_RANGE) >> 2;
+    int cx2 = std::min(x2 + SPAWN_MARGIN, SPAWN_RANGE) >> 2;
+    int cz2 = std::min(z2 + SPAWN_MARGIN, SPAWN_RANGE) >> 2;
+    if (cx1 > cx2 || cz1 > cz2)
+        return 0;
+
+    uint64_t spawnL = 0;
+    for (int id : spawnbiomes)
+        spawnL |= 1ULL << id;
+
+    // first on the coarse layer, which is almost free
+    if (!checkPotential(g, mc, L_BIOME_256, 8, 2, seed,
+            cx1 << 2, cz1 << 2, (cx2 << 2) + 3, (cz2 << 2) + 3, spawnL, 0, 1))
+        return 0;
+
+    // then the cells themselves, unless that costs about as much as getSpawn
+    int w = cx2 - cx1 + 1;
+    int h = cz2 - cz1 + 1;
+    int n = 2 * (SPAWN_RANGE >> 2) + 1;
+    if (4 * w*h > n*n)
+        return 1;
+
+    const Layer *l = &g->layers[L_RIVER_MIX_4];
+    int *area = borrowCache(l, w, h);
+    applySeed(g, seed);
+    genArea(l, area, cx1, cz1, w, h);
+    int ok = 0;
+    for (int i = 0; i < w*h && !ok; i++)
+        ok = area[i] >= 0 && area[i] < 64 && ((spawnL >> area[i]) & 1);
+    returnScratch();
+    return ok;
+}
+
 int testCond(StructPos *spos, int64_t seed, const Condition *cond, int mc, LayerStack *g, volatile bool *abort)
 {
     int x1, x2, z1, z2;
@@ -562,6 +1219,8 @@ int testCond(StructPos *spos, int64_t seed, const Condition *cond, int mc, Layer
     Pos p[128];
 
     StructPos *sout = spos + cond->save;
+    if (g)
+        setMemoSeed(g, seed);
 
     switch (cond->type)
     {
@@ -652,23 +1311,14 @@ L_qm_any:
 
 
     case F_DESERT:
-        sconf = mc <= MC_1_12 ? DESERT_PYRAMID_CONFIG_112 : DESERT_PYRAMID_CONFIG;
-        goto L_struct_any;
     case F_HUT:
-        sconf = mc <= MC_1_12 ? SWAMP_HUT_CONFIG_112 : SWAMP_HUT_CONFIG;
-        goto L_struct_any;
     case F_JUNGLE:
-        sconf = mc <= MC_1_12 ? JUNGLE_PYRAMID_CONFIG_112 : JUNGLE_PYRAMID_CONFIG;
-        goto L_struct_any;
     case F_IGLOO:
-        sconf = mc <= MC_1_12 ? IGLOO_CONFIG_112 : IGLOO_CONFIG;
-        goto L_struct_any;
-    case F_MONUMENT:    sconf = MONUMENT_CONFIG;    goto L_struct_any;
-    case F_VILLAGE:     sconf = VILLAGE_CONFIG;     goto L_struct_any;
-    case F_OUTPOST:     sconf = OUTPOST_CONFIG;     goto L_struct_any;
-    case F_MANSION:     sconf = MANSION_CONFIG;     goto L_struct_any;
-
-L_struct_any:
+    case F_MONUMENT:
+    case F_VILLAGE:
+    case F_OUTPOST:
+    case F_MANSION:
+        getFilterStructConfig(cond->type, mc, &sconf);
         x1 = cond->x1;
         z1 = cond->z1;
         x2 = cond->x2;
@@ -747,8 +1397,9 @@ L_struct_any:
             x2 += spos[cond->relative].cx;
             z2 += spos[cond->relative].cz;
         }
+        if (*abort || !isSpawnPlausible(g, mc, seed, x1, z1, x2, z2))
+            return 0;
         applySeed(g, seed);
-        if (*abort) return 0;
         pc = getSpawn(mc, g, NULL, seed);
         if (pc.x >= x1 && pc.x <= x2 && pc.z >= z1 && pc.z <= z2)
         {
@@ -887,31 +1538,52 @@ L_biome_filter_any:
                 return 1;
             if (mc < MC_1_13)
                 return 0;
-            thread_local LayerStack g_otemp;
-            if (!g_otemp.entry_1)
-                setupGenerator(&g_otemp, MC_1_13);
-            g = &g_otemp;
+            g = getThreadGenerator(MC_1_13);
+            setMemoSeed(g, seed);
         }
         valid = 0;
         if (rx2 >= rx1 || rz2 >= rz1 || !*abort)
         {
             int w = rx2-rx1+1;
             int h = rz2-rz1+1;
-            int *area = allocCache(&g->layers[qual], w, h);
+            if (!hasBiomeFilter(cond->bfilter))
+            {
+                // only exclusions, which can fail early without the whole area
+                return checkExclusions(g, qual, seed, rx1, rz1, w, h,
+                        cond->exclb, cond->exclm, abort);
+            }
+            // seeds where a required biome cannot generate from the biomes on
+            // the coarse layers are rejected before any fine layer is made
+            uint64_t reqL = cond->bfilter.riverToFind | cond->bfilter.oceanToFind;
+            uint64_t reqM = cond->bfilter.riverToFindM;
+            if (s <= 2 && (reqL || reqM))
+            {
+                int bx1 = rx1 << s, bz1 = rz1 << s;
+                int bx2 = ((rx2 + 1) << s) - 1, bz2 = ((rz2 + 1) << s) - 1;
+                if (!checkPotential(g, mc, L_BIOME_256, 8, 2, seed, bx1, bz1, bx2, bz2, reqL, reqM))
+                    return 0;
+                if (*abort || !checkPotential(g, mc, L_RARE_BIOME_64, 6, 3, seed, bx1, bz1, bx2, bz2, reqL, reqM))
+                    return 0;
+            }
+            // the biome filter rejects most seeds on the coarse layers, before
+            // the area is generated at full scale
+            int *area = borrowCache(&g->layers[qual], w, h);
             if (checkForBiomes(g, qual, area, seed, rx1, rz1, w, h, cond->bfilter, 0) > 0)
             {
-                // check biome exclusion
-                uint64_t b = 0, bm = 0;
-                for (int i = 0; i < w*h; i++)
+                valid = 1;
+                if (cond->exclb || cond->exclm)
                 {
-                    int id = area[i];
-                    if (id < 128) b |= (1ULL << id);
-                    else bm |= (1ULL << (id-128));
+                    for (int i = 0; i < w*h; i++)
+                    {
+                        if (isExcluded(area[i], cond->exclb, cond->exclm))
+                        {
+                            valid = 0;
+                            break;
+                        }
+                    }
                 }
-                if ((b & cond->exclb) == 0 && (bm & cond->exclm) == 0)
-                    valid = 1;
             }
-            free(area);
+            returnScratch();
         }
         return valid;
 
@@ -945,28 +1617,220 @@ L_biome_filter_any:
 
 
 
+void addCondStats(CondStats stats[100], CondTally tally[100])
+{
+    for (int i = 0; i < 100; i++)
+    {
+        for (int j = 0; j < STAGE_NUM; j++)
+        {
+            if (!tally[i].cnt[j])
+                continue;
+            stats[i].cnt[j] += tally[i].cnt[j];
+            stats[i].pass[j] += tally[i].pass[j];
+            stats[i].tsc[j] += tally[i].tsc[j];
+            tally[i].cnt[j] = 0;
+            tally[i].pass[j] = 0;
+            tally[i].tsc[j] = 0;
+        }
+    }
+}
+
+int testCondTally(CondTally tally[100], int stage, StructPos *spos, int64_t seed,
+        const Condition *cond, int mc, LayerStack *g, volatile bool *abort)
+{
+    if (!tally)
+        return testCond(spos, seed, cond, mc, g, abort);
+
+    uint64_t t = __rdtsc();
+    int ok = testCond(spos, seed, cond, mc, g, abort);
+    CondTally *ct = tally + cond->save;
+    ct->tsc[stage] += __rdtsc() - t;
+    ct->cnt[stage]++;
+    ct->pass[stage] += (ok != 0);
+    return ok;
+}
+
+// maximum number of structure positions that are hoisted for a condition
+#define HOIST_MAX 64
+
+struct HoistedStruct
+{
+    StructureConfig sconf;
+    int n;                  // number of positions in area
+    Pos p[HOIST_MAX];
+};
+
+/* Finds the attempted positions of a structure condition, inside the condition
+ * area. These only depend on the lower 48 bits, as long as the area does not
+ * move with the upper bits. Returns false if there are too many positions.
+ */
+static bool hoistStructCond(HoistedStruct *hs, StructPos *spos, int64_t seed,
+        const Condition *cond, int mc)
+{
+    int x1, z1, x2, z2, rx1, rz1, rx2, rz2, rx, rz, valid;
+    StructureConfig sconf;
+
+    if (!getFilterStructConfig(cond->type, mc, &sconf))
+        return false;
+
+    x1 = cond->x1;
+    z1 = cond->z1;
+    x2 = cond->x2;
+    z2 = cond->z2;
+    if (cond->relative)
+    {
+        x1 += spos[cond->relative].cx;
+        z1 += spos[cond->relative].cz;
+        x2 += spos[cond->relative].cx;
+        z2 += spos[cond->relative].cz;
+    }
+
+    if (sconf.regionSize == 32)
+    {
+        rx1 = x1 >> 9;
+        rz1 = z1 >> 9;
+        rx2 = x2 >> 9;
+        rz2 = z2 >> 9;
+    }
+    else
+    {
+        rx1 = (x1 / (sconf.regionSize << 4)) - (x1 < 0);
+        rz1 = (z1 / (sconf.regionSize << 4)) - (z1 < 0);
+        rx2 = (x2 / (sconf.regionSize << 4)) - (x2 < 0);
+        rz2 = (z2 / (sconf.regionSize << 4)) - (z2 < 0);
+    }
+
+    hs->sconf = sconf;
+    hs->n = 0;
+    for (rz = rz1; rz <= rz2; rz++)
+    {
+        for (rx = rx1; rx <= rx2; rx++)
+        {
+            Pos pc = getStructurePos(sconf, seed, rx, rz, &valid);
+            if (valid && pc.x >= x1 && pc.x <= x2 && pc.z >= z1 && pc.z <= z2)
+            {
+                if (hs->n >= HOIST_MAX)
+                    return false;
+                hs->p[hs->n++] = pc;
+            }
+        }
+    }
+    return true;
+}
+
+/* Equivalent of testCond() for a structure condition with hoisted positions,
+ * which only has to check the biome viability for the full seed.
+ */
+static int testHoistedCond(StructPos *spos, int64_t seed, const Condition *cond,
+        const HoistedStruct *hs, int mc, LayerStack *g)
+{
+    StructPos *sout = spos + cond->save;
+    int xt = 0, zt = 0, qual = 0;
+
+    sout->cx = 0;
+    sout->cz = 0;
+
+    for (int i = 0; i < hs->n; i++)
+    {
+        Pos pc = hs->p[i];
+        if (!isViableStructurePos(hs->sconf.structType, mc, g, seed, pc.x, pc.z))
+            continue;
+
+        xt += pc.x;
+        zt += pc.z;
+
+        if (++qual >= cond->count)
+        {
+            sout->sconf = hs->sconf;
+            sout->cx = xt / qual;
+            sout->cz = zt / qual;
+            return 1;
+        }
+    }
+    return 0;
+}
+
 int64_t searchFamily(int64_t seedbuf[], int64_t s, int scnt, int mc,
-        LayerStack *g, const Condition cond[], int ccnt, StructPos *spos, volatile bool *abort)
+        LayerStack *g, const Condition cond[], int ccnt, StructPos *spos, volatile bool *abort,
+        CondTally tally[100])
 {
     const Condition *c, *ce = cond + ccnt;
 
     if (*abort)
         return 0;
 
+    // The base has passed the 48-bit stage already, which is only repeated
+    // for the positions of each block, so it does not count in the tally.
     for (c = cond; c != ce; c++)
         if (!testCond(spos, s, c, mc, NULL, abort))
             return 0;
 
+    // Positions that do not change with the upper 16 bits are marked as
+    // stable. Structure conditions that are placed relative to such positions
+    // can have their area scan done once for the whole block of seeds.
+    bool stable[100] = {};
+    HoistedStruct *hoisted[100] = {};
+    // kept by the thread, as this runs for every base that passes the 48-bit stage
+    thread_local std::vector<HoistedStruct> hbuf;
+    int hcnt = 0;
+
     for (c = cond; c != ce; c++)
+    {
         if (g_filterinfo.list[c->type].cat != CAT_48)
             break;
+        stable[c->save] = true;
+    }
+    const Condition *cfull = c;
+    if (hbuf.size() < (size_t)(ce - cfull))
+        hbuf.resize(ce - cfull);
+
+    for (; c != ce; c++)
+    {
+        bool refstable = !c->relative || stable[c->relative];
+        stable[c->save] = false;
+
+        if (c->type >= F_BIOME && c->type <= F_TEMPS)
+        {
+            stable[c->save] = refstable;
+        }
+        else if (refstable && c->type >= F_DESERT && c->type <= F_MANSION)
+        {
+            HoistedStruct *hs = &hbuf[hcnt];
+            if (!hoistStructCond(hs, spos, s, c, mc))
+                continue;
+            if (hs->n < c->count)
+            {   // not enough attempts for any seed of the block
+                return 0;
+            }
+            hoisted[c->save] = hs;
+            hcnt++;
+        }
+    }
 
     int n = 0;
     while (scnt--)
     {
-        for (const Condition *ct = c; ct != ce; ct++)
-            if (!testCond(spos, s, ct, mc, g, abort))
+        for (const Condition *ct = cfull; ct != ce; ct++)
+        {
+            HoistedStruct *hs = hoisted[ct->save];
+            if (!hs)
+            {
+                if (!testCondTally(tally, STAGE_FULL, spos, s, ct, mc, g, abort))
+                    goto L_NEXT_SEED;
+                continue;
+            }
+            uint64_t t = tally ? __rdtsc() : 0;
+            int ok = testHoistedCond(spos, s, ct, hs, mc, g);
+            if (tally)
+            {
+                CondTally *tc = tally + ct->save;
+                tc->tsc[STAGE_FULL] += __rdtsc() - t;
+                tc->cnt[STAGE_FULL]++;
+                tc->pass[STAGE_FULL] += (ok != 0);
+            }
+            if (!ok)
                 goto L_NEXT_SEED;
+        }
         seedbuf[n++] = s;
 L_NEXT_SEED:;
         if (*abort)
@@ -976,3 +1840,34 @@ L_NEXT_SEED:;
 
     return n;
 }
+
+int testSeedGroup(int64_t seeds[], int scnt, int mc, LayerStack *g,
+        const Condition cond[], int ccnt, volatile bool *abort, CondTally tally[100])
+{
+    const Condition *c, *ce = cond + ccnt;
+    StructPos spos[100] = {};
+
+    if (scnt <= 0 || *abort)
+        return 0;
+
+    for (c = cond; c != ce; c++)
+        if (!testCondTally(tally, STAGE_48, spos, seeds[0] & MASK48, c, mc, NULL, abort))
+            return 0;
+
+    // the positions of the 48-bit conditions are shared by the group
+    for (c = cond; c != ce; c++)
+        if (g_filterinfo.list[c->type].cat != CAT_48)
+            break;
+    const Condition *cfull = c;
+
+    int n = 0;
+    for (int i = 0; i < scnt && !*abort; i++)
+    {
+        for (c = cfull; c != ce; c++)
+            if (!testCondTally(tally, STAGE_FULL, spos, seeds[i], c, mc, g, abort))
+                break;
+        if (c == ce)
+            seeds[n++] = seeds[i];
+    }
+    return n;
+}
@@ -3,6 +3,11 @@
 
 #include "cubiomes/finders.h"
 
+#include <QString>
+
+#include <atomic>
+#include <vector>
+
 
 enum
 {
@@ -274,35 +279,80 @@ struct Condition
 
 struct Candidate
 {
-    struct __attribute__((packed)) SPos
+    // The structures of a condition occupy the 2x2 regions from the cell
+    // (x,z), with their configuration given as an index into the config table
+    // of the candidate stream, rather than a copy for each region.
+    struct SPos
     {
-        StructureConfig sconf;
-        int x, z;
+        int16_t cfg;
+        int16_t save;   // of the condition
+        int32_t x, z;
     };
 
     // a candidate is a seed base and the structure positions it encompases
     int64_t seed;
-    SPos spos[];
+    std::vector<SPos> spos;
 };
 
-struct CandidateList
+// The seed bases of a condition moved to one region cell. The moved bases
+// are a rotation of the sorted bases, so each cell is a sorted run that can
+// be regenerated from its position, rather than being stored.
+struct CandidateRun
 {
-    union {
-        Candidate *items; // list of candidate items
-        char *mem;
-    };
-    int64_t isiz; // sizeof Candidate, each with scnt structures
-    int64_t scnt; // structures in each base item
-    int64_t bcnt; // number of base items
+    int64_t seed;   // next seed of this run
+    int64_t off;    // offset that moves the bases to this cell
+    uint32_t i0;    // index of the base that yields the lowest seed
+    uint32_t j;     // position in the run
+    int x, z;       // region cell
+};
+
+// Candidates of a condition with seed bases, as a merge over its cell runs.
+struct CandidateSource
+{
+    std::vector<int64_t> bases;     // sorted 48-bit seed bases
+    int cfg;                        // index into the config table
+    int save;                       // of the condition
+    int type;                       // filter type of the condition
+    std::vector<CandidateRun> heap; // runs with the lowest next seed at front
+};
+
+struct CandidateStream
+{
+    std::vector<CandidateSource> src;
+    std::vector<StructureConfig> conf; // config table of the structures
+    int64_t next;   // lower bound for the next candidate
+    Candidate cur;  // current candidate
+};
+
+
+enum { MSG_INFO, MSG_WARN };
+
+/* Callbacks through which the search engine informs its frontend. The GUI
+ * presents these as dialogs, while the headless searcher logs them to stderr.
+ * They can be called from the search thread.
+ */
+struct SearchHooks
+{
+    void (*message)(int level, QString title, QString text);
+    void (*protobaseOpen)(QString path);
+    void (*protobaseClose)();
 };
 
+extern SearchHooks g_searchhooks;
 
 
-/* Attempts to construct a list of 48-bit bases that should be further checked.
- * Any conditions that would result in a list larger than a buffer size will
- * not be preloaded in this way.
+/* Attempts to set up a stream of the 48-bit bases, starting at 'start', that
+ * should be further checked. Any conditions that would need more memory than
+ * a buffer size for their cell runs will not be streamed in this way.
+ * Returns false if no condition has precomputed seed bases.
  */
-CandidateList getCandidates(int mc, const Condition *cond, int ccnt, int64_t bufmax);
+bool initCandidates(CandidateStream *cs, int mc, const Condition *cond, int ccnt,
+        int64_t start, int64_t bufmax);
+
+/* Advances to the next candidate of the stream, which are generated in
+ * ascending order. Returns false at the end of the stream.
+ */
+bool nextCandidate(CandidateStream *cs);
 
 
 struct StructPos
@@ -311,12 +361,87 @@ struct StructPos
     int cx, cz; // effective center position
 };
 
+/* Sets the positions of the conditions that the current candidate of the
+ * stream meets in the region cells it was found at, as testCond() would, and
+ * marks them in 'known' (indexed like the positions), so they do not have to
+ * be tested again.
+ */
+void getCandidatePos(const CandidateStream *cs, StructPos *spos, bool *known);
+
+
+/* Reorders the conditions so that cheap and selective checks are performed
+ * first, while every condition stays behind the condition it references.
+ * Conditions that only depend on the lower 48 bits are kept in front of
+ * those that need the full seed. Returns false if the references cannot be
+ * resolved (missing or circular).
+ */
+bool planConditions(Condition *cond, int ccnt, int mc);
+
+/* Returns a generator for the given version that belongs to the calling
+ * thread. Each thread keeps one for every version it has used, so they only
+ * have to be set up once per version, and a generator stays valid for the
+ * life of the thread. The seed has to be applied by the caller.
+ * The 1:256 to 1:4 layers of these generators remember their last area, so
+ * the conditions of one seed in testCond() share overlapping areas.
+ */
+LayerStack *getThreadGenerator(int mc);
+
+/* Scratch buffers of the calling thread, which replace allocCache() and
+ * free() for layer areas on hot paths. A buffer grows as needed and is kept,
+ * so a thread that is warmed up does not allocate. Buffers are borrowed and
+ * returned in stack order, so they can be nested.
+ */
+int *borrowScratch(size_t n);
+void returnScratch();
+
+// A scratch buffer for generating an area of a layer, as with allocCache().
+static inline int *borrowCache(const Layer *layer, int w, int h)
+{
+    return borrowScratch(getMinCacheSize(layer, w, h));
+}
+
+enum { STAGE_48, STAGE_FULL, STAGE_NUM };
+
+// Profiling counters of a worker for each condition, indexed by condition ID.
+struct CondTally
+{
+    uint64_t cnt[STAGE_NUM];    // number of tests
+    uint64_t pass[STAGE_NUM];   // number of tests that succeeded
+    uint64_t tsc[STAGE_NUM];    // time stamp counter cycles spent
+};
+
+// Shared profiling counters that the worker tallies are added to.
+struct CondStats
+{
+    std::atomic<uint64_t> cnt[STAGE_NUM];
+    std::atomic<uint64_t> pass[STAGE_NUM];
+    std::atomic<uint64_t> tsc[STAGE_NUM];
+};
+
+/* Adds the tallies of a worker for all condition IDs to the shared counters
+ * and clears them.
+ */
+void addCondStats(CondStats stats[100], CondTally tally[100]);
 
 int testCond(StructPos *spos, int64_t seed, const Condition *cond, int mc, LayerStack *g, volatile bool *abort);
 
+/* Same as testCond(), but records the test in the tally of the condition for
+ * the given stage, if a tally is provided.
+ */
+int testCondTally(CondTally tally[100], int stage, StructPos *spos, int64_t seed,
+        const Condition *cond, int mc, LayerStack *g, volatile bool *abort);
+
 int64_t searchFamily(int64_t seedbuf[], int64_t s, int scnt, int mc,
-        LayerStack *g, const Condition cond[], int ccnt, StructPos *spos, volatile bool *abort);
+        LayerStack *g, const Condition cond[], int ccnt, StructPos *spos, volatile bool *abort,
+        CondTally tally[100] = NULL);
 
+/* Tests a group of seeds that share the same lower 48 bits, such as the seeds
+ * of a seed list, where the 48-bit stage of the conditions is only done once
+ * for the group. The seeds that pass are moved to the front of the array.
+ * Returns the number of seeds that pass.
+ */
+int testSeedGroup(int64_t seeds[], int scnt, int mc, LayerStack *g,
+        const Condition cond[], int ccnt, volatile bool *abort, CondTally tally[100] = NULL);
 
 
 #endif // SEARCH_H
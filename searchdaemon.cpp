@@ -0,0 +1,318 @@
+#include "searchdaemon.h"
+#include "cutil.h"
+
+#include <QJsonDocument>
+#include <QJsonArray>
+
+#include <algorithm>
+
+#include <inttypes.h>
+#include <stdio.h>
+
+
+static const char *g_jobstates[] = { "queued", "running", "done", "aborted", "failed" };
+static const char *g_searchtypes[] = { "all64", "inc48", "candidates", "list" };
+
+static QJsonObject error(const QString& msg)
+{
+    return QJsonObject{ {"ok", false}, {"error", msg} };
+}
+
+static QString seedString(int64_t seed)
+{
+    return QString::asprintf("%" PRId64, seed);
+}
+
+// seeds are accepted as strings, which hold 64 bits, or as numbers
+static bool parseSeed(const QJsonValue& v, int64_t *seed)
+{
+    if (v.isString())
+    {
+        bool ok;
+        *seed = v.toString().toLongLong(&ok, 0);
+        return ok;
+    }
+    if (v.isDouble())
+    {
+        *seed = (int64_t) v.toDouble();
+        return true;
+    }
+    return false;
+}
+
+SearchDaemon::SearchDaemon(int threads, const QString& cachedir, QObject *parent)
+    : QObject(parent)
+    , server(this),sthread(this),ptimer(this),timer(),jobs(),current(),nextid(1)
+{
+    sthread.setThreads(threads);
+    sthread.setCacheDir(cachedir);
+    sthread.setStatsFile(NULL);
+
+    connect(&server, &QLocalServer::newConnection, this, &SearchDaemon::newConnection);
+    connect(&sthread, &SearchThread::finish, this, &SearchDaemon::searchFinish);
+    connect(&ptimer, &QTimer::timeout, this, &SearchDaemon::poll);
+}
+
+SearchDaemon::~SearchDaemon()
+{
+    sthread.stop();
+    sthread.wait();
+}
+
+bool SearchDaemon::listen(const QString& name)
+{
+    // a socket that was left behind by a crash would block the name
+    QLocalServer::removeServer(name);
+    if (!server.listen(name))
+    {
+        fprintf(stderr, "Failed to listen on %s: %s\n", name.toLocal8Bit().data(),
+                server.errorString().toLocal8Bit().data());
+        return false;
+    }
+    fprintf(stderr, "Listening on: %s\n", server.fullServerName().toLocal8Bit().data());
+    return true;
+}
+
+void SearchDaemon::newConnection()
+{
+    QLocalSocket *sock;
+    while ((sock = server.nextPendingConnection()) != NULL)
+    {
+        connect(sock, &QLocalSocket::readyRead, this, [this, sock]() { readRequests(sock); });
+        connect(sock, &QLocalSocket::disconnected, sock, &QObject::deleteLater);
+    }
+}
+
+void SearchDaemon::readRequests(QLocalSocket *sock)
+{
+    while (sock->canReadLine())
+    {
+        QByteArray line = sock->readLine().trimmed();
+        if (line.isEmpty())
+            continue;
+        QJsonDocument doc = QJsonDocument::fromJson(line);
+        QJsonObject resp;
+        if (doc.isObject())
+            resp = handle(doc.object());
+        else
+            resp = error("Request is not a JSON object.");
+        sock->write(QJsonDocument(resp).toJson(QJsonDocument::Compact) + "\n");
+    }
+    if (sock->bytesAvailable() > DAEMON_MAXLINE)
+    {
+        sock->write(QJsonDocument(error("Request is too long.")).toJson(QJsonDocument::Compact) + "\n");
+        sock->disconnectFromServer();
+    }
+}
+
+QJsonObject SearchDaemon::handle(const QJsonObject& req)
+{
+    QString cmd = req["cmd"].toString();
+    if (cmd == "submit")
+        return submit(req);
+
+    if (cmd == "status" && !req.contains("id"))
+    {
+        QJsonArray list;
+        for (const DaemonJob& job : jobs)
+            list.append(status(job));
+        return QJsonObject{ {"ok", true}, {"jobs", list} };
+    }
+
+    int id = req["id"].toInt();
+    if (!jobs.contains(id))
+        return error("Unknown job.");
+    DaemonJob& job = jobs[id];
+
+    if (cmd == "status")
+    {
+        return status(job);
+    }
+    else if (cmd == "results")
+    {
+        int from = std::max(req["from"].toInt(), 0);
+        int max = req.contains("max") ? req["max"].toInt() : 10000;
+        // the results are taken first, so the state covers all of them
+        if (id == current)
+            poll();
+        QJsonArray seeds;
+        int i;
+        for (i = from; i < job.seeds.size() && i - from < max; i++)
+            seeds.append(seedString(job.seeds[i]));
+        return QJsonObject{
+            {"ok", true}, {"seeds", seeds}, {"next", std::max(i, from)},
+            {"state", g_jobstates[job.state]} };
+    }
+    else if (cmd == "abort")
+    {
+        job.abort = true;
+        if (job.state == JOB_QUEUED)
+            job.state = JOB_ABORTED;
+        else if (job.state == JOB_RUNNING)
+            sthread.stop();
+        return QJsonObject{ {"ok", true} };
+    }
+    else if (cmd == "remove")
+    {
+        if (job.state == JOB_QUEUED || job.state == JOB_RUNNING)
+            return error("Job is still active, abort it first.");
+        jobs.remove(id);
+        return QJsonObject{ {"ok", true} };
+    }
+    return error("Unknown command: " + cmd);
+}
+
+QJsonObject SearchDaemon::submit(const QJsonObject& req)
+{
+    DaemonJob job = {};
+    job.state = JOB_QUEUED;
+    job.searchtype = SEARCH_ALL64;
+    job.start = 0;
+    job.end = MASK48;
+
+    for (const QJsonValue& v : req["conditions"].toArray())
+    {
+        QByteArray ba = QByteArray::fromHex(v.toString().toLatin1());
+        if (ba.size() != sizeof(Condition))
+            return error("Invalid condition.");
+        job.condvec.push_back(*(Condition*) ba.data());
+    }
+    if (job.condvec.empty())
+        return error("No conditions.");
+
+    job.mc = str2mc(req["mc"].toString("1.16").toLatin1().data());
+    if (job.mc < 0)
+        return error("Unknown MC version.");
+
+    if (req.contains("type"))
+    {
+        QString t = req["type"].toString();
+        int n = sizeof(g_searchtypes) / sizeof(*g_searchtypes);
+        for (job.searchtype = 0; job.searchtype < n; job.searchtype++)
+            if (t == g_searchtypes[job.searchtype])
+                break;
+        if (job.searchtype == n)
+            return error("Unknown search type: " + t);
+    }
+
+    if ((req.contains("start") && !parseSeed(req["start"], &job.start)) ||
+        (req.contains("end") && !parseSeed(req["end"], &job.end)))
+    {
+        return error("Invalid seed range.");
+    }
+    if (job.start < 0 || job.start > MASK48 || job.end < 0 || job.end > MASK48 ||
+        job.start > job.end)
+    {
+        return error(QString::asprintf(
+                "Invalid seed range, it has to lie within [0, %" PRId64 "].", (int64_t)MASK48));
+    }
+
+    if (job.searchtype == SEARCH_LIST)
+    {
+        job.listpath = req["list"].toString();
+        if (job.listpath.isEmpty())
+            return error("A seed list is required for the list search.");
+        // the progress covers the list rather than a range of seeds
+        job.start = 0;
+        job.end = MASK48;
+    }
+    job.next = job.start;
+
+    job.id = nextid++;
+    jobs[job.id] = job;
+    if (!current)
+        startNext();
+    return QJsonObject{ {"ok", true}, {"id", job.id} };
+}
+
+QJsonObject SearchDaemon::status(const DaemonJob& job) const
+{
+    double done = job.next - job.start;
+    QJsonObject st = {
+        {"ok", true},
+        {"id", job.id},
+        {"state", g_jobstates[job.state]},
+        {"type", g_searchtypes[job.searchtype]},
+        {"start", seedString(job.start)},
+        {"end", seedString(job.end)},
+        {"next", seedString(job.next)},
+        {"progress", done / (job.end - job.start + 1)},
+        {"results", job.seeds.size()},
+        {"truncated", job.truncated},
+        {"elapsed", job.elapsed},
+    };
+    // the progress of a list search is not a number of seed bases
+    if (job.searchtype != SEARCH_LIST)
+        st["rate"] = job.elapsed > 0 ? done / job.elapsed : 0.0;
+    return st;
+}
+
+void SearchDaemon::startNext()
+{
+    current = 0;
+    for (DaemonJob& job : jobs)
+    {
+        if (job.state != JOB_QUEUED)
+            continue;
+        bool ok = sthread.set(job.searchtype, job.start, job.end, job.mc, job.condvec);
+        if (ok && job.searchtype == SEARCH_LIST)
+            ok = sthread.setSeedList(job.listpath);
+        if (!ok)
+        {
+            job.state = JOB_FAILED;
+            continue;
+        }
+        job.state = JOB_RUNNING;
+        current = job.id;
+        timer.start();
+        ptimer.start(DAEMON_POLL_MS);
+        sthread.start();
+        return;
+    }
+}
+
+// takes the results and progress of the running job
+void SearchDaemon::poll()
+{
+    if (!current)
+        return;
+    DaemonJob& job = jobs[current];
+    // the progress has to be read first, as it only covers queued results
+    int64_t s48 = sthread.progress();
+    sthread.takeResults(job.seeds);
+    if (s48 >= job.next)
+        job.next = s48 + 1;
+    job.elapsed = timer.elapsed() * 1e-3;
+
+    if (job.seeds.size() >= DAEMON_MAXRESULTS && !job.truncated)
+    {
+        job.truncated = true;
+        sthread.stop();
+    }
+}
+
+void SearchDaemon::searchFinish(int64_t s48)
+{
+    poll();
+    ptimer.stop();
+    // the next search can only start once the thread has returned
+    sthread.wait();
+    if (current)
+    {
+        DaemonJob& job = jobs[current];
+        // an incomplete job keeps the watermark of its progress, which only
+        // covers the bases that have been searched completely
+        if (job.abort || job.truncated || s48 < job.end)
+        {
+            job.state = JOB_ABORTED;
+        }
+        else
+        {
+            job.state = JOB_DONE;
+            job.next = job.end + 1;
+        }
+        fprintf(stderr, "Job %d %s with %d seeds\n", job.id,
+                g_jobstates[job.state], job.seeds.size());
+    }
+    startNext();
+}
@@ -0,0 +1,95 @@
+#ifndef SEARCHDAEMON_H
+#define SEARCHDAEMON_H
+
+#include "searchthread.h"
+
+#include <QObject>
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QJsonObject>
+#include <QElapsedTimer>
+#include <QTimer>
+#include <QMap>
+#include <QVector>
+
+#define DAEMON_POLL_MS      500
+#define DAEMON_MAXRESULTS   (1 << 24)
+#define DAEMON_MAXLINE      (1 << 20)
+
+enum { JOB_QUEUED, JOB_RUNNING, JOB_DONE, JOB_ABORTED, JOB_FAILED };
+
+struct DaemonJob
+{
+    int id;
+    int state;
+    bool abort;             // abort requested
+    bool truncated;         // stopped at DAEMON_MAXRESULTS
+    int searchtype;
+    int mc;
+    int64_t start;
+    int64_t end;
+    QString listpath;       // input of a seed list search
+    QVector<Condition> condvec;
+    QVector<int64_t> seeds;
+    int64_t next;           // next 48-bit seed to be searched
+    double elapsed;         // seconds
+};
+
+/* Serves searches on a local socket (a Unix domain socket, or a named pipe on
+ * Windows) for scripts. The daemon keeps its SearchThread and the protobases
+ * that have been loaded, so only the first search starts cold. Submitted
+ * searches run one after the other.
+ *
+ * Each request is a JSON object on one line and is answered by one line:
+ *
+ *  {"cmd": "submit", "conditions": ["<hex>", ...], "mc": "1.16",
+ *   "type": "all64", "start": "0", "end": "281474976710655", "list": "<file>"}
+ *                      -> {"ok": true, "id": 1}
+ *  {"cmd": "status"}   -> {"ok": true, "jobs": [<status>, ...]}
+ *  {"cmd": "status", "id": 1}
+ *                      -> {"ok": true, "id": 1, "state": "running",
+ *                          "next": "...", "progress": 0.25, "results": 10,
+ *                          "elapsed": 12.5, "rate": 1.2e9}
+ *  {"cmd": "results", "id": 1, "from": 0, "max": 10000}
+ *                      -> {"ok": true, "seeds": ["...", ...], "next": 10,
+ *                          "state": "running"}
+ *  {"cmd": "abort", "id": 1}
+ *  {"cmd": "remove", "id": 1}
+ *
+ * The conditions are encoded as in the "#Cond:" lines of a progress file.
+ * Seeds are strings, since JSON numbers do not hold 64 bits. The results are
+ * streamed by asking for them from the returned "next" until the job is no
+ * longer queued or running. Failed requests are answered with
+ * {"ok": false, "error": "..."}.
+ */
+class SearchDaemon : public QObject
+{
+    Q_OBJECT
+
+public:
+    SearchDaemon(int threads, const QString& cachedir, QObject *parent = nullptr);
+    ~SearchDaemon();
+
+    bool listen(const QString& name);
+
+protected:
+    void newConnection();
+    void readRequests(QLocalSocket *sock);
+    QJsonObject handle(const QJsonObject& req);
+    QJsonObject submit(const QJsonObject& req);
+    QJsonObject status(const DaemonJob& job) const;
+
+    void startNext();
+    void poll();
+    void searchFinish(int64_t s48);
+
+    QLocalServer server;
+    SearchThread sthread;
+    QTimer ptimer;
+    QElapsedTimer timer;
+    QMap<int, DaemonJob> jobs;  // by id, which is also the queue order
+    int current;                // id of the running job, or 0
+    int nextid;
+};
+
+#endif // SEARCHDAEMON_H
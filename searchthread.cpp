@@ -1,7 +1,10 @@
 #include "searchthread.h"
-#include <QMessageBox>
+
+#include <QFileInfo>
 
 #include <x86intrin.h>
+#include <algorithm>
+#include <string.h>
 
 #define TSC_INTERRUPT_CNT ((uint64_t)1 << 30)
 
@@ -12,65 +15,95 @@ class FamilyBlock: public QRunnable
     // look through, following a full 64-bit seed.
 public:
     SearchThread *master;   // master thread for results
+    SearchBase *base;       // base that collects the results
+    int idx;                // block index in base
     int64_t sstart;         // starting seed
     int scnt;               // number of upper 16-bit combinations to check
     int mc;                 // mincraft version
     const Condition* cond;  // conditions to be met
     int ccnt;               // number of conditions
 
-    FamilyBlock(SearchThread *t, int64_t sstart, int scnt, int mc,
+    FamilyBlock(SearchThread *t, SearchBase *base, int idx, int64_t sstart, int scnt, int mc,
                 const Condition* cond, int ccnt)
-        : master(t),sstart(sstart),scnt(scnt),mc(mc),cond(cond),ccnt(ccnt)
+        : master(t),base(base),idx(idx),sstart(sstart),scnt(scnt),mc(mc),cond(cond),ccnt(ccnt)
     {
         setAutoDelete(true);
     }
 
     void run()
     {
-        LayerStack g;
-        setupGenerator(&g, mc);
+        LayerStack *g = getThreadGenerator(mc);
         StructPos spos[100] = {};
+        CondTally tally[100] = {};
         int64_t seedbuf[scnt];
 
-        int n = searchFamily(seedbuf, sstart, scnt, mc, &g, cond, ccnt, spos, &master->abortsearch);
-        if (n && !master->abortsearch)
+        int n = searchFamily(seedbuf, sstart, scnt, mc, g, cond, ccnt, spos,
+                &master->abortsearch, tally);
+        addCondStats(master->stats, tally);
+
+        // each block has its own result buffer, so the lock is only held for
+        // the bookkeeping
+        bool aborted = master->abortsearch;
+        if (!aborted && n)
         {
-            master->mutex.lock();
+            QVector<int64_t>& seeds = base->blockseeds[idx];
+            seeds.reserve(n);
             for (int i = 0; i < n; i++)
-            {
-                master->seeds.push_back(seedbuf[i]);
-            }
-            master->mutex.unlock();
+                seeds.push_back(seedbuf[i]);
         }
+
+        master->mutex.lock();
+        if (aborted)
+            base->aborted = true;
+        base->pending--;
+        master->blockspending--;
+        master->blockdone.wakeAll();
+        master->mutex.unlock();
     }
 };
 
 // called from main GUI thread
-bool SearchThread::set(int type, int64_t start48, int mc, const QVector<Condition>& cv)
+bool SearchThread::set(int type, int64_t start48, int64_t end48, int mc, const QVector<Condition>& cv)
 {
     this->searchtype = type;
     this->sstart = start48;
+    this->send = end48;
     this->mc = mc;
     this->condvec = cv;
+    resetStats();
+    ckptpath.clear();
+    ckpt.searchtype = type;
+    ckpt.mc = mc;
+    ckpt.end = end48;
+    ckpt.condvec = cv;
+    ckpt.seeds.clear();
+    ckpt.listpath.clear();
+    ckpt.listpos = 0;
+    resultq.clear();
+    lastdone = start48 - 1;
     char refbuf[100] = {};
 
     for (const Condition& c : cv)
     {
         if (c.save < 1 || c.save > 99)
         {
-            QMessageBox::warning(NULL, "Warning", QString::asprintf("Condition with invalid ID [%02d].", c.save));
+            g_searchhooks.message(MSG_WARN, "Warning", QString::asprintf("Condition with invalid ID [%02d].", c.save));
             return false;
         }
-        if (c.relative && refbuf[c.relative] == 0)
+        if (++refbuf[c.save] > 1)
         {
-            QMessageBox::warning(NULL, "Warning", QString::asprintf(
-                    "Condition with ID [%02d] has a broken reference position:\n"
-                    "condition missing or out of order.", c.save));
+            g_searchhooks.message(MSG_WARN, "Warning", QString::asprintf("More than one condition with ID [%02d].", c.save));
             return false;
         }
-        if (++refbuf[c.save] > 1)
+    }
+
+    for (const Condition& c : cv)
+    {
+        if (c.relative && (c.relative < 1 || c.relative > 99 || refbuf[c.relative] == 0))
         {
-            QMessageBox::warning(NULL, "Warning", QString::asprintf("More than one condition with ID [%02d].", c.save));
+            g_searchhooks.message(MSG_WARN, "Warning", QString::asprintf(
+                    "Condition with ID [%02d] has a broken reference position:\n"
+                    "condition missing.", c.save));
             return false;
         }
         if (c.type >= F_BIOME && c.type <= F_BIOME_256_OTEMP)
@@ -78,12 +111,12 @@ bool SearchThread::set(int type, int64_t start48, int mc, const QVector<Conditio
             if ((c.exclb & (c.bfilter.riverToFind | c.bfilter.oceanToFind)) ||
                 (c.exclm & c.bfilter.riverToFindM))
             {
-                QMessageBox::warning(NULL, "Warning", QString::asprintf("Biome filter condition with ID [%02d] has contradicting flags for include and exclude.", c.save));
+                g_searchhooks.message(MSG_WARN, "Warning", QString::asprintf("Biome filter condition with ID [%02d] has contradicting flags for include and exclude.", c.save));
                 return false;
             }
             if (c.count == 0)
             {
-                QMessageBox::information(NULL, "Info", QString::asprintf("Biome filter condition with ID [%02d] specifies no biomes.", c.save));
+                g_searchhooks.message(MSG_INFO, "Info", QString::asprintf("Biome filter condition with ID [%02d] specifies no biomes.", c.save));
             }
         }
         if (c.type == F_TEMPS)
@@ -92,145 +125,719 @@ bool SearchThread::set(int type, int64_t start48, int mc, const QVector<Conditio
             int h = c.z2 - c.z1 + 1;
             if (w * h < c.count)
             {
-                QMessageBox::warning(NULL, "Warning", QString::asprintf(
+                g_searchhooks.message(MSG_WARN, "Warning", QString::asprintf(
                         "Temperature category condition with ID [%02d] has too many restrictions (%d) for the area (%d x %d).",
                         c.save, c.count, w, h));
                 return false;
             }
             if (c.count == 0)
             {
-                QMessageBox::information(NULL, "Info", QString::asprintf("Temperature category condition with ID [%02d] specifies no restrictions.", c.save));
+                g_searchhooks.message(MSG_INFO, "Info", QString::asprintf("Temperature category condition with ID [%02d] specifies no restrictions.", c.save));
             }
         }
     }
 
+    // choose an order for the conditions that is cheap to check
+    if (!planConditions(condvec.data(), condvec.size(), mc))
+    {
+        g_searchhooks.message(MSG_WARN, "Warning",
+                "The reference positions of the conditions form a cycle.");
+        return false;
+    }
+
     return true;
 }
 
-// does the 48-bit seed meet the conditions c..ce?
-static bool isCandidate(int64_t s48, int mc, const Condition *c, const Condition *ce, volatile bool *abort)
+// does the 48-bit seed meet the conditions c..ce, other than those known to pass?
+static bool isCandidate(int64_t s48, int mc, const Condition *c, const Condition *ce,
+        volatile bool *abort, CondTally *tally, StructPos *spos = NULL,
+        const bool *known = NULL)
 {
-    StructPos spos[100] = {};
+    StructPos sbuf[100];
+    if (!spos)
+    {
+        memset(sbuf, 0, sizeof(sbuf));
+        spos = sbuf;
+    }
     for (; c != ce; c++)
-        if (!testCond(spos, s48, c, mc, NULL, abort))
+    {
+        if (known && known[c->save])
+            continue;
+        if (!testCondTally(tally, STAGE_48, spos, s48, c, mc, NULL, abort))
             return false;
+    }
     return true;
 }
 
+class BaseBlock: public QRunnable
+{
+    // This class is a threadpool item for a range of 48-bit seeds that are
+    // checked against the conditions, to find the candidates.
+public:
+    SearchThread *master;   // master thread for results
+    SearchChunk *chunk;     // range to check and the resulting candidates
+    int mc;                 // mincraft version
+    const Condition* cond;  // conditions to be met
+    int ccnt;               // number of conditions
+    int n48;                // leading 48-bit conditions to keep the survivors of, or 0
+
+    BaseBlock(SearchThread *t, SearchChunk *chunk, int mc, const Condition* cond, int ccnt, int n48)
+        : master(t),chunk(chunk),mc(mc),cond(cond),ccnt(ccnt),n48(n48)
+    {
+        setAutoDelete(true);
+    }
+
+    void run()
+    {
+        QVector<int64_t> bases, survivors;
+        CondTally tally[100] = {};
+        const Condition *c48 = cond + n48, *ce = cond + ccnt;
+        for (int64_t s48 = chunk->start; s48 <= chunk->end && !master->abortsearch; s48++)
+        {
+            StructPos spos[100] = {};
+            if (!isCandidate(s48, mc, cond, c48, &master->abortsearch, tally, spos))
+                continue;
+            if (n48)
+                survivors.push_back(s48);
+            if (isCandidate(s48, mc, c48, ce, &master->abortsearch, tally, spos))
+                bases.push_back(s48);
+        }
+        addCondStats(master->stats, tally);
+
+        master->mutex.lock();
+        chunk->bases.swap(bases);
+        chunk->survivors.swap(survivors);
+        chunk->done = true;
+        master->blockdone.wakeAll();
+        master->mutex.unlock();
+    }
+};
+
+class ListBlock: public QRunnable
+{
+    // This class is a threadpool item for a part of a seed list, that is
+    // checked against the conditions.
+public:
+    SearchThread *master;   // master thread for results
+    ListChunk *chunk;       // seeds to check, and the results
+    int mc;                 // mincraft version
+    const Condition* cond;  // conditions to be met
+    int ccnt;               // number of conditions
+
+    ListBlock(SearchThread *t, ListChunk *chunk, int mc, const Condition* cond, int ccnt)
+        : master(t),chunk(chunk),mc(mc),cond(cond),ccnt(ccnt)
+    {
+        setAutoDelete(true);
+    }
+
+    void run()
+    {
+        LayerStack *g = getThreadGenerator(mc);
+        CondTally tally[100] = {};
+        int64_t *seeds = chunk->seeds.data();
+        int cnt = chunk->seeds.size();
+        int n = 0;
+
+        for (int i = 0, j; i < cnt && !master->abortsearch; i = j)
+        {
+            for (j = i + 1; j < cnt && ((seeds[i] ^ seeds[j]) & MASK48) == 0; j++);
+            int m = testSeedGroup(seeds + i, j - i, mc, g, cond, ccnt,
+                    &master->abortsearch, tally);
+            memmove(seeds + n, seeds + i, m * sizeof(*seeds));
+            n += m;
+        }
+        addCondStats(master->stats, tally);
+
+        master->mutex.lock();
+        chunk->seeds.resize(n);
+        chunk->done = true;
+        master->blockdone.wakeAll();
+        master->mutex.unlock();
+    }
+};
+
 
 void SearchThread::run()
 {
     abortsearch = false;
-    elapsed.start();
+    stopped = false;
+    stopbase = 0;
+    cutoff = false;
 
     const Condition *cond = condvec.data();
     int64_t ccnt = condvec.size();
 
-    CandidateList cl = getCandidates(mc, cond, ccnt, PRECOMPUTE48_BUFSIZ);
-    int64_t ci;
-    char *sp;
+    CandidateStream cs;
     int64_t s48 = sstart;
     uint64_t tsc_next = __rdtsc() + TSC_INTERRUPT_CNT;
+    CondTally tally[100] = {};
+    ckpttimer.start();
 
-    if (cl.mem)
+    if (searchtype == SEARCH_LIST)
     {
-        // a pre-computed list of candidates exists, skip forwards to starting point
-        for (ci = 0, sp = cl.mem; ci < cl.bcnt; ci++, sp += cl.isiz)
-            if ((s48 = *(int64_t*)sp) >= sstart)
-                break;
-
-        for (; ci < cl.bcnt && !abortsearch; ci++, sp += cl.isiz)
+        s48 = searchList(cond, ccnt);
+    }
+    else if (initCandidates(&cs, mc, cond, ccnt, sstart, PRECOMPUTE48_BUFSIZ))
+    {
+        // stream the pre-computed candidates from the starting point
+        bool more;
+        while ((more = nextCandidate(&cs)) && !abortsearch)
         {
-            s48 = *(int64_t*)sp;
-            if (isCandidate(s48, mc, cond, cond+ccnt, &abortsearch))
+            s48 = cs.cur.seed;
+            if (s48 > send)
+                break;
+            // the conditions of the stream are met at the positions it found
+            StructPos spos[100] = {};
+            bool known[100] = {};
+            getCandidatePos(&cs, spos, known);
+            if (isCandidate(s48, mc, cond, cond+ccnt, &abortsearch, tally, spos, known))
             {
                 if (abortsearch)
                     break;
-                if (runSearch48(s48, cond, ccnt) && stoponres)
+                if (queueBase(s48, cond, ccnt))
                     break;
             }
             uint64_t t = __rdtsc();
             if (t > tsc_next)
             {
-                emit baseDone(s48);
+                addCondStats(stats, tally);
+                reportProgress(s48);
                 tsc_next = t + TSC_INTERRUPT_CNT;
             }
         }
-        if (ci == cl.bcnt)
-            s48 = MASK48+1;
-
-        free(cl.mem);
+        addCondStats(stats, tally);
+        if (!more || s48 > send)
+            s48 = send+1;
     }
     else
     {
-        // go through all 48-bit seeds
-        for (; s48 <= MASK48 && !abortsearch; s48++)
+        // the survivors of the 48-bit conditions may be known from earlier
+        // searches, otherwise go through all 48-bit seeds
+        int n48 = 0;
+        while (n48 < ccnt && g_filterinfo.list[cond[n48].type].cat == CAT_48)
+            n48++;
+        if (!cachedir.isEmpty() && !cache48.open(cachedir, mc, cond, n48) && n48 > 0)
+            fprintf(stderr, "48-bit survivor cache is not available.\n");
+        s48 = scanCache(s48, cond, ccnt, n48);
+        if (s48 <= send)
+            s48 = scanRange(s48, cond, ccnt);
+        cache48.close();
+    }
+
+    // wait for the bases that are still in the pipeline
+    drainBases(0);
+    pool.waitForDone();
+
+    // the final checkpoint continues after the last base that is complete,
+    // or with the base that was stopped at, the rest of which is not searched
+    if (stopped)
+        saveProgress(stopbase - 1, true);
+    else if (abortsearch)
+        saveProgress(lastdone.load(std::memory_order_relaxed), true);
+    else
+        saveProgress(s48 - 1, true);
+
+    // the resume point of an aborted search is the same as in its checkpoint
+    if (stopped)
+        s48 = stopbase;
+    else if (abortsearch)
+        s48 = lastdone.load(std::memory_order_relaxed) + 1;
+
+    if (statsfp)
+        dumpStats(statsfp);
+
+    emit finish(s48);
+}
+
+void SearchThread::resetStats()
+{
+    for (int i = 0; i < 100; i++)
+    {
+        for (int j = 0; j < STAGE_NUM; j++)
+        {
+            stats[i].cnt[j] = 0;
+            stats[i].pass[j] = 0;
+            stats[i].tsc[j] = 0;
+        }
+    }
+}
+
+/* Prints the profiling counters of the conditions, in the order in which
+ * they were checked.
+ */
+void SearchThread::dumpStats(FILE *fp)
+{
+    uint64_t total[STAGE_NUM] = {};
+    for (const Condition& c : condvec)
+        for (int j = 0; j < STAGE_NUM; j++)
+            total[j] += stats[c.save].tsc[j];
+
+    fprintf(fp, "Condition statistics ([ID] stage: tests, passed, time share):\n");
+    for (const Condition& c : condvec)
+    {
+        const CondStats& cs = stats[c.save];
+        fprintf(fp, "[%02d] %-28s", c.save, g_filterinfo.list[c.type].name);
+        for (int j = 0; j < STAGE_NUM; j++)
         {
-            if (isCandidate(s48, mc, cond, cond+ccnt, &abortsearch))
+            uint64_t cnt = cs.cnt[j], pass = cs.pass[j], tsc = cs.tsc[j];
+            fprintf(fp, "  %s: %12" PRIu64 " %6.2f%% %5.1f%%", j == STAGE_48 ? "48" : "full", cnt,
+                    cnt ? 100.0 * pass / cnt : 0.0, total[j] ? 100.0 * tsc / total[j] : 0.0);
+        }
+        fprintf(fp, "\n");
+    }
+}
+
+/* Checks the 48-bit seeds from s48 to the end of the search range, in chunks
+ * that are distributed onto the thread pool. The chunks are collected in order
+ * so the candidates are queued in ascending order, and the lowest fully
+ * completed seed remains a safe point to resume from.
+ * Returns the next 48-bit seed that has not been fully processed.
+ */
+int64_t SearchThread::scanRange(int64_t s48, const Condition* cond, int ccnt)
+{
+    std::deque<SearchChunk*> chunks;
+    const int maxchunks = 2 * pool.maxThreadCount();
+    uint64_t tsc_next = __rdtsc() + TSC_INTERRUPT_CNT;
+    int64_t snext = s48;
+    bool stop = false;
+
+    // the cache is extended if the range continues from the part it covers
+    int n48 = 0;
+    if (cache48.isWritable() && s48 == cache48.covered() + 1)
+    {
+        while (n48 < ccnt && g_filterinfo.list[cond[n48].type].cat == CAT_48)
+            n48++;
+    }
+
+    while (!stop && !abortsearch)
+    {
+        while ((int)chunks.size() < maxchunks && snext <= send)
+        {
+            int64_t end = snext + SCAN48_CHUNKSIZ - 1;
+            if (end > send)
+                end = send;
+            SearchChunk *chunk = new SearchChunk{snext, end, false, {}, {}};
+            chunks.push_back(chunk);
+            pool.start(new BaseBlock(this, chunk, mc, cond, ccnt, n48));
+            snext = end + 1;
+        }
+        if (chunks.empty())
+            break;
+
+        SearchChunk *chunk = chunks.front();
+        mutex.lock();
+        while (!chunk->done)
+            blockdone.wait(&mutex);
+        mutex.unlock();
+        if (abortsearch)
+            break; // chunk may be incomplete
+
+        chunks.pop_front();
+        if (n48 && !cache48.append(chunk->survivors, chunk->start, chunk->end))
+            n48 = 0; // cache is full, but the chunks in flight collect anyway
+        for (int64_t b : chunk->bases)
+        {
+            if ((stop = queueBase(b, cond, ccnt)))
+                break;
+        }
+        if (!stop)
+            s48 = chunk->end + 1;
+        delete chunk;
+
+        uint64_t t = __rdtsc();
+        if (!stop && t > tsc_next)
+        {
+            cache48.flush();
+            reportProgress(s48 - 1);
+            tsc_next = t + TSC_INTERRUPT_CNT;
+        }
+    }
+
+    // chunks that are still queued stop early once the search is aborted
+    drainBases(0);
+    pool.waitForDone();
+    for (SearchChunk *chunk : chunks)
+        delete chunk;
+
+    return s48;
+}
+
+static bool cmp_listseed(int64_t a, int64_t b)
+{
+    uint64_t la = (uint64_t)a & MASK48, lb = (uint64_t)b & MASK48;
+    return la != lb ? la < lb : a < b;
+}
+
+/* Checks the seeds of the seed list against the conditions. The list is read
+ * in batches, which are sorted so that seeds with the same lower 48 bits are
+ * adjacent and share the 48-bit stage, and split into chunks for the thread
+ * pool. The results follow the order of the batches, but are sorted by their
+ * lower 48 bits within a batch. The progress is the part of the list that is
+ * done, scaled to the 48-bit range, and the list position of a checkpoint.
+ * Returns the progress at which the search ended.
+ */
+int64_t SearchThread::searchList(const Condition* cond, int ccnt)
+{
+    std::deque<ListChunk*> chunks;
+    const int maxchunks = 4 * pool.maxThreadCount();
+    QVector<int64_t> batch;
+    int64_t s48 = -1;
+    listdone = listPosition();
+
+    while (!abortsearch)
+    {
+        if ((int)chunks.size() < maxchunks && !listAtEnd())
+        {
+            batch.clear();
+            if (!readListBatch(&batch))
             {
-                if (abortsearch)
-                    break;
-                if (runSearch48(s48, cond, ccnt) && stoponres)
-                    break;
+                g_searchhooks.message(MSG_WARN, "Warning", QString::asprintf(
+                        "Seed list has an invalid line %" PRId64 ".", listreader.lineNumber()));
+                abortsearch = true;
+                break;
             }
-            uint64_t t = __rdtsc();
-            if (t > tsc_next)
+            std::sort(batch.begin(), batch.end(), cmp_listseed);
+            batch.erase(std::unique(batch.begin(), batch.end()), batch.end());
+
+            // split the batch at group boundaries
+            for (int i = 0, j; i < batch.size(); i = j)
             {
-                emit baseDone(s48);
-                tsc_next = t + TSC_INTERRUPT_CNT;
+                j = std::min(i + LIST_CHUNKSIZ, (int)batch.size());
+                while (j < batch.size() && ((batch[j-1] ^ batch[j]) & MASK48) == 0)
+                    j++;
+                ListChunk *chunk = new ListChunk{batch.mid(i, j - i), false, -1};
+                chunks.push_back(chunk);
+                pool.start(new ListBlock(this, chunk, mc, cond, ccnt));
             }
+            if (!chunks.empty())
+                chunks.back()->listpos = listPosition();
+            continue;
+        }
+        if (chunks.empty())
+            break;
+
+        ListChunk *chunk = chunks.front();
+        mutex.lock();
+        while (!chunk->done)
+            blockdone.wait(&mutex);
+        mutex.unlock();
+        if (abortsearch)
+            break; // chunk may be incomplete
+
+        chunks.pop_front();
+        if (!chunk->seeds.empty())
+        {
+            if (!ckptpath.isEmpty())
+                ckpt.seeds += chunk->seeds;
+            resultq.push(new ResultBatch{NULL, chunk->seeds});
+            if (stoponres)
+                abortsearch = true;
         }
+        if (chunk->listpos >= 0)
+        {
+            int64_t lsize = listSize();
+            s48 = lsize ? (int64_t)((double)chunk->listpos / lsize * MASK48) : MASK48;
+            lastdone.store(s48, std::memory_order_release);
+            listdone = chunk->listpos;
+            saveProgress(s48, false);
+        }
+        delete chunk;
     }
 
-    emit finish(s48);
+    pool.waitForDone();
+    for (ListChunk *chunk : chunks)
+        delete chunk;
+
+    if (!abortsearch)
+        s48 = MASK48;
+    return s48;
 }
 
-// search type options from combobox
-enum { SEARCH_ALL64 = 0, SEARCH_INC48 = 1, SEARCH_CANDIT = 2 };
+/* Streams the 48-bit seeds that pass the 48-bit conditions from the survivor
+ * cache, for the part of the search range that the cache covers, and checks
+ * them against the remaining conditions.
+ * Returns the next 48-bit seed that has not been processed.
+ */
+int64_t SearchThread::scanCache(int64_t s48, const Condition* cond, int ccnt, int n48)
+{
+    if (!cache48.isOpen() || s48 > cache48.covered())
+        return s48;
+
+    int64_t end = std::min(cache48.covered(), send);
+    uint64_t tsc_next = __rdtsc() + TSC_INTERRUPT_CNT;
+    CondTally tally[100] = {};
+    int64_t b = s48;
+
+    // the cached seeds have passed the 48-bit conditions already, which only
+    // have to be repeated for the positions that later conditions refer to
+    const Condition *cpos = cond;
+    for (int i = n48; i < ccnt; i++)
+    {
+        for (int j = 0; j < n48; j++)
+            if (cond[i].relative && cond[i].relative == cond[j].save)
+                cpos = cond + n48;
+    }
+
+    cache48.rewind();
+    while (!abortsearch && cache48.next(&b))
+    {
+        if (b < s48)
+            continue;
+        if (b > end)
+            break;
+        StructPos spos[100] = {};
+        if (cpos != cond && !isCandidate(b, mc, cond, cpos, &abortsearch, NULL, spos))
+            continue;
+        if (isCandidate(b, mc, cond+n48, cond+ccnt, &abortsearch, tally, spos))
+        {
+            if (abortsearch || queueBase(b, cond, ccnt))
+                break;
+        }
+        uint64_t t = __rdtsc();
+        if (t > tsc_next)
+        {
+            addCondStats(stats, tally);
+            reportProgress(b);
+            tsc_next = t + TSC_INTERRUPT_CNT;
+        }
+    }
+    addCondStats(stats, tally);
 
-bool SearchThread::runSearch48(int64_t s48, const Condition* cond, int ccnt)
+    return abortsearch ? b : end + 1;
+}
+
+/* Queues the upper 16-bit family of a 48-bit candidate onto the thread pool.
+ * The blocks of several bases can be in flight at once, so the workers do not
+ * idle at the end of each base. Returns true if the search should stop.
+ */
+bool SearchThread::queueBase(int64_t s48, const Condition* cond, int ccnt)
 {
     // found a 48-bit seed candidate
-    seeds.clear();
+    SearchBase *base = new SearchBase{s48, 0, false, {}, {}};
+    int blocksize, blockcnt;
 
     if (searchtype == SEARCH_CANDIT)
     {
-        seeds.push_back(s48);
+        base->seeds.push_back(s48);
+        blocksize = blockcnt = 0;
     }
     else if (searchtype == SEARCH_INC48)
     {
-        LayerStack g;
-        setupGenerator(&g, mc);
-        StructPos spos[100] = {};
-        int64_t seedbuf[1];
-        if (searchFamily(seedbuf, s48, 1, mc, &g, cond, ccnt, spos, &abortsearch))
-            seeds.push_back(seedbuf[0]);
+        blocksize = 1;
+        blockcnt = 1;
     }
     else
     {
         // distribute the search for the upper 16-bits onto a thread pool
-        const int blocksize = 0x200;
-        const int blockcnt = 0x10000 / blocksize;
-        for (int i = 0; i < blockcnt; i++)
-        {
-            pool.start(new FamilyBlock(this, s48, blocksize, mc, cond, ccnt));
-            s48 += (int64_t)blocksize << 48;
-        }
-        pool.waitForDone();
+        blocksize = 0x200;
+        blockcnt = 0x10000 / blocksize;
     }
 
-    if (!abortsearch)
+    // keep enough blocks queued that all threads stay busy, but limit the
+    // number of bases that are in flight
+    int maxpending = 4 * pool.maxThreadCount();
+    if (maxpending < 2 * blockcnt)
+        maxpending = 2 * blockcnt;
+
+    if (drainBases(maxpending - blockcnt))
+    {
+        delete base;
+        return true;
+    }
+
+    base->blockseeds.resize(blockcnt);
+
+    mutex.lock();
+    base->pending = blockcnt;
+    blockspending += blockcnt;
+    bases.push_back(base);
+    mutex.unlock();
+
+    for (int i = 0; i < blockcnt; i++)
     {
-        if (elapsed.elapsed() > 10)
+        pool.start(new FamilyBlock(this, base, i, s48, blocksize, mc, cond, ccnt));
+        s48 += (int64_t)blocksize << 48;
+    }
+
+    return drainBases(maxpending);
+}
+
+/* Reports the finished bases at the front of the pipeline, in order, and
+ * waits until no more than 'maxpending' blocks are outstanding.
+ * Returns true if the search should stop.
+ */
+bool SearchThread::drainBases(int maxpending)
+{
+    mutex.lock();
+    while (true)
+    {
+        while (!bases.empty() && bases.front()->pending == 0)
         {
-            emit baseDone(s48);
-            elapsed.start();
+            SearchBase *base = bases.front();
+            bases.pop_front();
+
+            // the progress and results stop at the first incomplete base
+            if (base->aborted)
+                cutoff = true;
+            if (!stopped && !cutoff)
+            {
+                mutex.unlock();
+                for (const QVector<int64_t>& seeds : base->blockseeds)
+                    base->seeds += seeds;
+                if (!base->seeds.empty())
+                {
+                    if (!ckptpath.isEmpty())
+                        ckpt.seeds += base->seeds;
+                    resultq.push(new ResultBatch{NULL, base->seeds});
+                    if (stoponres)
+                    {
+                        // later bases may be incomplete, so they are discarded
+                        stopped = true;
+                        stopbase = base->s48;
+                        abortsearch = true;
+                    }
+                }
+                // the results are queued before the progress is published
+                lastdone.store(base->s48, std::memory_order_release);
+                mutex.lock();
+            }
+            delete base;
         }
+
+        if (blockspending <= maxpending)
+            break;
+        blockdone.wait(&mutex);
     }
-    if (!seeds.empty())
+    mutex.unlock();
+
+    saveProgress(lastdone.load(std::memory_order_relaxed), false);
+
+    return stopped || abortsearch;
+}
+
+/* Publishes the search progress, which is the scan position of the 48-bit
+ * candidates, unless there are unfinished bases in the pipeline.
+ */
+void SearchThread::reportProgress(int64_t s48)
+{
+    mutex.lock();
+    if (!bases.empty())
+        s48 = bases.front()->s48 - 1;
+    if (cutoff)
+        s48 = lastdone.load(std::memory_order_relaxed);
+    mutex.unlock();
+    if (s48 > lastdone.load(std::memory_order_relaxed))
+        lastdone.store(s48, std::memory_order_release);
+    saveProgress(s48, false);
+}
+
+void SearchThread::setCheckpoint(QString path, int minutes, const QVector<int64_t>& seeds)
+{
+    ckptpath = path;
+    ckptinterval = (qint64)minutes * 60 * 1000;
+    ckpt.seeds = seeds;
+}
+
+bool SearchThread::setSeedList(QString path, int64_t listpos)
+{
+    listseeds.clear();
+    listidx = 0;
+    if (!listreader.openFile(path))
+    {
+        g_searchhooks.message(MSG_WARN, "Warning", "Failed to open seed list.");
+        return false;
+    }
+    if (!listreader.seek(listpos))
+    {
+        g_searchhooks.message(MSG_WARN, "Warning", "Seed list is shorter than its progress.");
+        return false;
+    }
+    // a checkpoint of the search continues in the same file
+    ckpt.listpath = QFileInfo(path).absoluteFilePath();
+    ckpt.listpos = listpos;
+    return true;
+}
+
+void SearchThread::setSeedList(const QVector<int64_t>& seeds)
+{
+    listreader.close();
+    listseeds = seeds;
+    listidx = 0;
+    ckpt.listpath.clear();
+}
+
+bool SearchThread::listAtEnd() const
+{
+    if (!listseeds.empty())
+        return listidx >= listseeds.size();
+    return listreader.atEnd();
+}
+
+// position in the seed list, in seeds or bytes of the file
+int64_t SearchThread::listPosition() const
+{
+    return listseeds.empty() ? listreader.position() : listidx;
+}
+
+int64_t SearchThread::listSize() const
+{
+    return listseeds.empty() ? listreader.size() : listseeds.size();
+}
+
+/* Reads up to LIST_BATCHSIZ seeds of the seed list. Lines that start with '#',
+ * such as the header of a progress file, are skipped.
+ * Returns false if the list has an invalid line.
+ */
+bool SearchThread::readListBatch(QVector<int64_t> *batch)
+{
+    if (!listseeds.empty())
     {
-        emit results(seeds, false);
+        int n = std::min(LIST_BATCHSIZ, listseeds.size() - listidx);
+        *batch += listseeds.mid(listidx, n);
+        listidx += n;
         return true;
     }
-    return false;
+
+    QByteArray line;
+    while (listreader.peek() == '#')
+        listreader.readLine(&line);
+    return listreader.readSeeds(batch, LIST_BATCHSIZ) >= 0;
+}
+
+/* Writes the checkpoint, with the search continuing after s48, if the autosave
+ * interval has passed.
+ */
+void SearchThread::saveProgress(int64_t s48, bool force)
+{
+    if (ckptpath.isEmpty())
+        return;
+    if (!force && ckpttimer.isValid() && ckpttimer.elapsed() < ckptinterval)
+        return;
+
+    // a list search resumes from its list position, so it needs the file
+    if (searchtype == SEARCH_LIST)
+    {
+        if (ckpt.listpath.isEmpty())
+            return;
+        ckpt.listpos = listdone;
+    }
+    ckpt.progress = s48 + 1;
+    if (!saveCheckpoint(ckptpath, ckpt))
+        fprintf(stderr, "Failed to write checkpoint: %s\n", ckptpath.toLocal8Bit().data());
+    ckpttimer.start();
+}
+
+bool SearchThread::takeResults(QVector<int64_t>& seeds)
+{
+    ResultBatch *b = resultq.takeAll();
+    if (!b)
+        return false;
+    while (b)
+    {
+        ResultBatch *next = b->next;
+        seeds += b->seeds;
+        delete b;
+        b = next;
+    }
+    return true;
 }
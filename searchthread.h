@@ -4,12 +4,109 @@
 #include <QThread>
 #include <QThreadPool>
 #include <QMutex>
+#include <QWaitCondition>
 #include <QVector>
 #include <QElapsedTimer>
+#include <QStandardPaths>
+
+#include <deque>
+#include <vector>
+#include <atomic>
 
 #include "search.h"
+#include "checkpoint.h"
+#include "seedreader.h"
+#include "survivorcache.h"
 
 #define PRECOMPUTE48_BUFSIZ ((int64_t)1 << 30)
+#define SCAN48_CHUNKSIZ     ((int64_t)1 << 16)
+#define LIST_BATCHSIZ       (1 << 20)
+#define LIST_CHUNKSIZ       (1 << 12)
+
+// default location of the 48-bit survivor cache, shared by the frontends
+#define CACHE48_DIR \
+    (QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation) + "/cubiomes-viewer/survivors48")
+
+// search types, of which the combobox offers those with an item
+enum { SEARCH_ALL64 = 0, SEARCH_INC48 = 1, SEARCH_CANDIT = 2, SEARCH_LIST = 3 };
+
+// A 48-bit candidate whose upper 16-bit family is being processed in blocks.
+struct SearchBase
+{
+    int64_t s48;
+    int pending;            // blocks that are still queued or running
+    bool aborted;           // some blocks were cut short by an abort
+    QVector<int64_t> seeds; // results, in block order once all are finished
+    std::vector<QVector<int64_t>> blockseeds; // results of each block
+};
+
+// A batch of results in the queue towards the frontend.
+struct ResultBatch
+{
+    ResultBatch *next;
+    QVector<int64_t> seeds;
+};
+
+// Lock-free queue of result batches. Batches can be pushed from any thread,
+// while a single consumer takes all of them at once.
+class ResultQueue
+{
+public:
+    ResultQueue() : head(NULL) {}
+    ~ResultQueue() { clear(); }
+
+    void push(ResultBatch *b)
+    {
+        b->next = head.load(std::memory_order_relaxed);
+        while (!head.compare_exchange_weak(b->next, b,
+                std::memory_order_release, std::memory_order_relaxed));
+    }
+
+    // returns the queued batches in the order they were pushed
+    ResultBatch *takeAll()
+    {
+        ResultBatch *b = head.exchange(NULL, std::memory_order_acquire);
+        ResultBatch *list = NULL;
+        while (b)
+        {
+            ResultBatch *next = b->next;
+            b->next = list;
+            list = b;
+            b = next;
+        }
+        return list;
+    }
+
+    void clear()
+    {
+        for (ResultBatch *b = takeAll(); b; )
+        {
+            ResultBatch *next = b->next;
+            delete b;
+            b = next;
+        }
+    }
+
+private:
+    std::atomic<ResultBatch*> head;
+};
+
+// A range of 48-bit seeds that is checked for candidates in one block.
+struct SearchChunk
+{
+    int64_t start, end;     // inclusive range
+    bool done;
+    QVector<int64_t> bases; // candidates found, in ascending order
+    QVector<int64_t> survivors; // seeds that pass the 48-bit conditions, for the cache
+};
+
+// A part of a seed list, where seeds with the same lower 48 bits are adjacent.
+struct ListChunk
+{
+    QVector<int64_t> seeds; // seeds to check, replaced by those that pass
+    bool done;
+    int64_t listpos;        // list position once this chunk is done, or -1
+};
 
 
 class SearchThread : public QThread
@@ -18,20 +115,62 @@ class SearchThread : public QThread
 
 public:
     SearchThread(QObject *parent) :
-        QThread(parent),mc(),sstart(),condvec(),pool(this),stoponres(),seeds(),mutex(),elapsed()
+        QThread(parent),mc(),sstart(),send(MASK48),condvec(),pool(this),stoponres()
+      , stopped(),stopbase(),cutoff(),bases(),blockspending(),mutex(),blockdone()
+      , resultq(),lastdone(-1)
+      , ckptpath(),ckptinterval(),ckpttimer(),ckpt(),listreader()
+      , listseeds(),listidx(),listdone(),cachedir(),cache48(),statsfp(stderr)
     {
+        resetStats();
     }
 
-    bool set(int type, int64_t start48, int mc, const QVector<Condition>& cv);
+    bool set(int type, int64_t start48, int64_t end48, int mc, const QVector<Condition>& cv);
+    void setThreads(int n) { pool.setMaxThreadCount(n > 0 ? n : QThread::idealThreadCount()); }
 
     void stop() { abortsearch = true; }
 
+    /* Enables the periodic checkpoint of the search, which will include the
+     * given results found so far. An empty path disables it.
+     */
+    void setCheckpoint(QString path, int minutes, const QVector<int64_t>& seeds);
+    void saveProgress(int64_t s48, bool force);
+    /* Sets the seed list for a search of type SEARCH_LIST, either as a file
+     * or as the seeds themselves, such as the results to refine.
+     */
+    bool setSeedList(QString path, int64_t listpos = 0);
+    void setSeedList(const QVector<int64_t>& seeds);
+    int searchType() const { return searchtype; }
+    /* Sets the directory of the 48-bit survivor cache. An empty path
+     * disables the cache.
+     */
+    void setCacheDir(QString dir) { cachedir = dir; }
+
     void run() override;
-    bool runSearch48(int64_t s48, const Condition* cond, int ccnt);
+    int64_t scanRange(int64_t s48, const Condition* cond, int ccnt);
+    int64_t scanCache(int64_t s48, const Condition* cond, int ccnt, int n48);
+    int64_t searchList(const Condition* cond, int ccnt);
+    bool listAtEnd() const;
+    int64_t listPosition() const;
+    int64_t listSize() const;
+    /* Position in the seed list up to which the search has checked all
+     * seeds, in seeds or bytes of the file. */
+    int64_t listDone() const { return listdone; }
+    bool readListBatch(QVector<int64_t> *batch);
+    bool queueBase(int64_t s48, const Condition* cond, int ccnt);
+    bool drainBases(int maxpending);
+    void reportProgress(int64_t s48);
+
+    // Takes the results that are ready, which the frontend polls for.
+    // Returns false if there were none.
+    bool takeResults(QVector<int64_t>& seeds);
+    // The last 48-bit seed for which all results are available.
+    int64_t progress() const { return lastdone.load(std::memory_order_acquire); }
+    void resetStats();
+    void dumpStats(FILE *fp);
+    // where the statistics are printed at the end of a search, or NULL
+    void setStatsFile(FILE *fp) { statsfp = fp; }
 
 signals:
-    int results(QVector<int64_t> seeds, bool countonly);
-    void baseDone(int64_t s48);
     void finish(int64_t s48);
 
 public slots:
@@ -40,17 +179,48 @@ public slots:
 protected:
     int mc;
     int64_t sstart;
+    int64_t send;
     QVector<Condition> condvec;
     QThreadPool pool;
     bool stoponres;
     int searchtype;
+    bool stopped;
+    int64_t stopbase;
+    bool cutoff;    // a base was aborted, so later bases do not count
 
 public:
-    QVector<int64_t> seeds;
+    // bases in the pipeline, in the order they were queued
+    std::deque<SearchBase*> bases;
+    int blockspending;
     QMutex mutex;
+    QWaitCondition blockdone;
     volatile bool abortsearch;
 
-    QElapsedTimer elapsed;
+    // results and progress towards the frontend
+    ResultQueue resultq;
+    std::atomic<int64_t> lastdone;
+
+    // profiling counters, indexed by condition ID
+    CondStats stats[100];
+
+protected:
+    // periodic checkpoint, maintained by the search thread
+    QString ckptpath;
+    qint64 ckptinterval;
+    QElapsedTimer ckpttimer;
+    Checkpoint ckpt;
+
+    // input of a seed list search
+    SeedReader listreader;
+    QVector<int64_t> listseeds;
+    int listidx;
+    int64_t listdone;       // list position up to which all seeds are checked
+
+    // survivors of the 48-bit conditions, shared between searches
+    QString cachedir;
+    SurvivorCache cache48;
+
+    FILE *statsfp;
 };
 
 #endif // SEARCHTHREAD_H
@@ -0,0 +1,150 @@
+#include "seedreader.h"
+
+
+SeedReader::SeedReader()
+    : file(),map(),buf(),begin(),pos(),end(),lineno(1)
+{
+}
+
+SeedReader::~SeedReader()
+{
+    close();
+}
+
+bool SeedReader::openFile(const QString& path)
+{
+    close();
+    file.setFileName(path);
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+
+    qint64 fsize = file.size();
+    if (fsize > 0)
+        map = file.map(0, fsize);
+    if (map)
+    {
+        begin = (const char*) map;
+        end = begin + fsize;
+    }
+    else
+    {
+        // not mappable (or empty), e.g. a pipe or some network drives
+        buf = file.readAll();
+        begin = buf.constData();
+        end = begin + buf.size();
+    }
+    pos = begin;
+    return true;
+}
+
+void SeedReader::setData(const QByteArray& data)
+{
+    close();
+    buf = data;
+    begin = pos = buf.constData();
+    end = begin + buf.size();
+}
+
+void SeedReader::close()
+{
+    if (map)
+        file.unmap(map);
+    map = NULL;
+    if (file.isOpen())
+        file.close();
+    buf.clear();
+    begin = pos = end = NULL;
+    lineno = 1;
+}
+
+bool SeedReader::seek(int64_t p)
+{
+    if (p < 0 || p > end - begin)
+        return false;
+    pos = begin + p;
+    lineno = 1;
+    for (const char *c = begin; c < pos; c++)
+        lineno += (*c == '\n');
+    return true;
+}
+
+bool SeedReader::readLine(QByteArray *line)
+{
+    if (pos == end)
+        return false;
+    const char *p = pos;
+    while (p < end && *p != '\n')
+        p++;
+    const char *e = p;
+    if (e > pos && e[-1] == '\r')
+        e--;
+    *line = QByteArray(pos, e - pos);
+    pos = p < end ? p + 1 : p;
+    lineno++;
+    return true;
+}
+
+static inline bool isBlank(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+/* Parses a decimal integer in [-2^63, 2^63) that fills the rest of the line,
+ * up to surrounding blanks, and advances past the line break.
+ * Returns 1 for a seed, 0 for a blank line and -1 otherwise.
+ */
+static int parseLine(const char **pp, const char *end, int64_t *seed)
+{
+    const char *p = *pp;
+    while (p < end && isBlank(*p))
+        p++;
+    if (p == end || *p == '\n')
+    {
+        *pp = p < end ? p + 1 : p;
+        return 0;
+    }
+
+    bool neg = false;
+    if (*p == '-' || *p == '+')
+        neg = (*p++ == '-');
+
+    const char *digits = p;
+    uint64_t v = 0;
+    while (p < end && (unsigned)(*p - '0') < 10)
+    {
+        // 19 digits cannot overflow, so only the 20th needs to be checked
+        if (p - digits >= 19 && (v > UINT64_MAX / 10 || v * 10 > UINT64_MAX - (*p - '0')))
+            return -1;
+        v = v * 10 + (*p++ - '0');
+    }
+    if (p == digits || v > (neg ? (uint64_t)1 << 63 : ((uint64_t)1 << 63) - 1))
+        return -1;
+
+    while (p < end && isBlank(*p))
+        p++;
+    if (p < end && *p != '\n')
+        return -1;
+
+    *pp = p < end ? p + 1 : p;
+    *seed = neg ? (int64_t)(0 - v) : (int64_t)v;
+    return 1;
+}
+
+int SeedReader::readSeeds(QVector<int64_t> *seeds, int max)
+{
+    int n = 0;
+    while (n < max && pos < end && *pos != '#')
+    {
+        int64_t seed;
+        int r = parseLine(&pos, end, &seed);
+        if (r < 0)
+            return -1;
+        lineno++;
+        if (r > 0)
+        {
+            seeds->push_back(seed);
+            n++;
+        }
+    }
+    return n;
+}
@@ -0,0 +1,68 @@
+#ifndef SEEDREADER_H
+#define SEEDREADER_H
+
+#include <QFile>
+#include <QByteArray>
+#include <QVector>
+
+#include <stdint.h>
+
+
+/* Reads seed lists, one decimal integer per line, as written by the results
+ * export and the progress files. Files are memory mapped where possible and
+ * parsed in place, so a list can be consumed in chunks without holding a copy
+ * of the text or a string per line.
+ */
+class SeedReader
+{
+public:
+    SeedReader();
+    ~SeedReader();
+
+    /* Maps a file for reading, or reads it into memory if the file cannot be
+     * mapped. Returns false if the file cannot be opened.
+     */
+    bool openFile(const QString& path);
+
+    /* Reads from a buffer in memory, such as the clipboard text.
+     */
+    void setData(const QByteArray& data);
+
+    void close();
+
+    bool atEnd() const { return pos == end; }
+    /* The next character, or 0 at the end of the data. */
+    char peek() const { return pos < end ? *pos : 0; }
+    int64_t position() const { return pos - begin; }
+    int64_t size() const { return end - begin; }
+    /* Line number of the current position, starting at 1. */
+    int64_t lineNumber() const { return lineno; }
+
+    /* Continues at a position that an earlier reader of the same data has
+     * reached, such as the progress of a seed list search. Returns false if the
+     * position is outside the data.
+     */
+    bool seek(int64_t p);
+
+    /* Reads a line, without the line break.
+     */
+    bool readLine(QByteArray *line);
+
+    /* Parses up to 'max' seeds and appends them to 'seeds'. Blank lines are
+     * skipped and parsing stops early at a line that starts with '#'.
+     * Returns the number of seeds read, or -1 if a line is not an integer, in
+     * which case the position remains at the start of that line.
+     */
+    int readSeeds(QVector<int64_t> *seeds, int max);
+
+protected:
+    QFile file;
+    uchar *map;
+    QByteArray buf;
+    const char *begin;
+    const char *pos;
+    const char *end;
+    int64_t lineno;
+};
+
+#endif // SEEDREADER_H
@@ -0,0 +1,203 @@
+#include "seedring.h"
+#include "searchthread.h"
+
+#include <QThread>
+
+#include <algorithm>
+#include <new>
+
+
+static size_t ringSize(int capacity)
+{
+    return sizeof(RingHead) + capacity * sizeof(int64_t);
+}
+
+bool SeedRing::create(const QString& key, int nrings, int64_t start, int64_t end)
+{
+    detach();
+    shm.setKey(key);
+    size_t size = sizeof(RingControl) + nrings * ringSize(RING_CAPACITY);
+    if (!shm.create(size))
+    {
+        // a segment that was left behind by a crash is released by detaching
+        if (shm.error() != QSharedMemory::AlreadyExists || !shm.attach())
+            return false;
+        shm.detach();
+        if (!shm.create(size))
+            return false;
+    }
+
+    ctl = new (shm.data()) RingControl;
+    ctl->magic = RING_MAGIC;
+    ctl->nrings = nrings;
+    ctl->capacity = RING_CAPACITY;
+    ctl->end = end;
+    ctl->unitsiz = RING_UNITSIZ;
+    ctl->next = start;
+    ctl->abort = 0;
+
+    for (int i = 0; i < nrings; i++)
+    {
+        RingHead *rh = new (ring(i)) RingHead;
+        rh->head = 0;
+        rh->tail = 0;
+        rh->claim = -1;
+        rh->done = -1;
+        rh->state = RING_IDLE;
+    }
+    return true;
+}
+
+bool SeedRing::attach(const QString& key)
+{
+    detach();
+    shm.setKey(key);
+    if (!shm.attach())
+        return false;
+    ctl = (RingControl*) shm.data();
+    if (ctl->magic != RING_MAGIC)
+    {
+        detach();
+        return false;
+    }
+    return true;
+}
+
+void SeedRing::detach()
+{
+    if (shm.isAttached())
+        shm.detach();
+    ctl = NULL;
+}
+
+RingHead *SeedRing::ring(int i)
+{
+    char *p = (char*) ctl + sizeof(RingControl) + i * ringSize(ctl->capacity);
+    return (RingHead*) p;
+}
+
+int64_t SeedRing::claimUnit(int i, int64_t *end)
+{
+    RingHead *rh = ring(i);
+    int64_t s = ctl->next.load();
+    do
+    {
+        if (s > ctl->end)
+        {
+            rh->claim = -1;
+            return -1;
+        }
+        // published before the unit is taken, so the progress never passes it
+        rh->done = s - 1;
+        rh->claim = s;
+    }
+    while (!ctl->next.compare_exchange_weak(s, s + ctl->unitsiz));
+
+    *end = std::min(s + ctl->unitsiz - 1, ctl->end);
+    return s;
+}
+
+bool SeedRing::push(int i, const QVector<int64_t>& seeds)
+{
+    RingHead *rh = ring(i);
+    int64_t *buf = ringData(i);
+    uint64_t cap = ctl->capacity;
+    uint64_t h = rh->head.load(std::memory_order_relaxed);
+
+    for (int64_t s : seeds)
+    {
+        while (h - rh->tail.load(std::memory_order_acquire) >= cap)
+        {
+            if (ctl->abort)
+                return false;
+            QThread::msleep(1);
+        }
+        buf[h % cap] = s;
+        rh->head.store(++h, std::memory_order_release);
+    }
+    return true;
+}
+
+int SeedRing::drain(int i, QVector<int64_t> *seeds)
+{
+    RingHead *rh = ring(i);
+    int64_t *buf = ringData(i);
+    uint64_t cap = ctl->capacity;
+    uint64_t t = rh->tail.load(std::memory_order_relaxed);
+    uint64_t h = rh->head.load(std::memory_order_acquire);
+
+    for (uint64_t j = t; j < h; j++)
+        seeds->push_back(buf[j % cap]);
+    rh->tail.store(h, std::memory_order_release);
+    return h - t;
+}
+
+int64_t SeedRing::progress()
+{
+    int64_t p = std::min(ctl->next.load(), ctl->end + 1) - 1;
+    for (int i = 0; i < ctl->nrings; i++)
+    {
+        RingHead *rh = ring(i);
+        if (rh->claim.load() >= 0)
+            p = std::min(p, rh->done.load());
+    }
+    return p;
+}
+
+int runRingWorker(SearchThread& sthread, const QString& key, int i,
+        int type, int mc, const QVector<Condition>& cv)
+{
+    SeedRing ring;
+    if (!ring.attach(key) || i < 0 || i >= ring.control()->nrings)
+    {
+        fprintf(stderr, "Failed to attach to search: %s\n", key.toLocal8Bit().data());
+        return 1;
+    }
+    RingControl *ctl = ring.control();
+    RingHead *rh = ring.ring(i);
+    rh->state = RING_RUNNING;
+    sthread.setStatsFile(NULL); // one search per unit would be too verbose
+
+    // a unit of a worker that failed is continued first
+    int64_t start = rh->claim, end = -1;
+    if (start >= 0)
+    {
+        end = std::min(start + ctl->unitsiz - 1, ctl->end);
+        start = rh->done + 1;
+    }
+    if (start < 0 || start > end)
+        start = ring.claimUnit(i, &end);
+
+    QVector<int64_t> seeds;
+    while (start >= 0 && !ctl->abort)
+    {
+        if (!sthread.set(type, start, end, mc, cv))
+        {
+            rh->state = RING_FAILED;
+            return 1;
+        }
+        sthread.start();
+        bool finished;
+        do
+        {
+            finished = sthread.wait(100);
+            // the progress only covers results that are already queued
+            int64_t s48 = sthread.progress();
+            seeds.clear();
+            sthread.takeResults(seeds);
+            if (!ring.push(i, seeds) || ctl->abort)
+                sthread.stop();
+            else if (s48 >= start)
+                rh->done = s48;
+        }
+        while (!finished);
+
+        if (ctl->abort)
+            break; // the unit may be incomplete, so it remains claimed
+        rh->done = end;
+        start = ring.claimUnit(i, &end);
+    }
+
+    rh->state = RING_DONE;
+    return 0;
+}
@@ -0,0 +1,90 @@
+#ifndef SEEDRING_H
+#define SEEDRING_H
+
+#include <QSharedMemory>
+#include <QString>
+#include <QVector>
+
+#include <atomic>
+#include <stdint.h>
+
+#define RING_MAGIC      0x43565247 // "CVRG"
+#define RING_CAPACITY   (1 << 16)
+#define RING_UNITSIZ    ((int64_t)1 << 32)
+
+enum { RING_IDLE, RING_RUNNING, RING_DONE, RING_FAILED };
+
+// Shared state of a search that runs in worker processes. The 48-bit range is
+// taken by the workers in units, so the progress stays nearly contiguous.
+struct RingControl
+{
+    uint32_t magic;
+    int32_t nrings;
+    int32_t capacity;
+    int64_t end;                    // last 48-bit seed of the search
+    int64_t unitsiz;
+    std::atomic<int64_t> next;      // next 48-bit seed to be taken
+    std::atomic<int32_t> abort;
+};
+
+// Ring buffer of results from one worker process to the frontend, with a
+// single producer and a single consumer.
+struct RingHead
+{
+    std::atomic<uint64_t> head;     // number of seeds written
+    std::atomic<uint64_t> tail;     // number of seeds read
+    std::atomic<int64_t> claim;     // start of the unit being searched, or -1
+    std::atomic<int64_t> done;      // last seed of the unit with all results written
+    std::atomic<int32_t> state;
+};
+
+/* Shared memory with the control block of a process search, followed by a
+ * ring for each worker. The atomics are lock-free, so they also work between
+ * processes.
+ */
+class SeedRing
+{
+public:
+    SeedRing() : shm(),ctl() {}
+    ~SeedRing() { detach(); }
+
+    /* Creates the shared memory for a search of [start, end] (frontend). */
+    bool create(const QString& key, int nrings, int64_t start, int64_t end);
+    /* Attaches to the shared memory of a search (worker). */
+    bool attach(const QString& key);
+    void detach();
+
+    bool isAttached() const { return ctl != NULL; }
+    RingControl *control() { return ctl; }
+    RingHead *ring(int i);
+
+    /* Takes the next unit of the search for ring i.
+     * Returns the start of the unit, or -1 if none are left.
+     */
+    int64_t claimUnit(int i, int64_t *end);
+    /* Writes seeds to ring i, waiting while it is full.
+     * Returns false if the search was aborted.
+     */
+    bool push(int i, const QVector<int64_t>& seeds);
+    /* Reads the seeds that are available in ring i. */
+    int drain(int i, QVector<int64_t> *seeds);
+    /* The last 48-bit seed for which all results have been written. */
+    int64_t progress();
+
+protected:
+    int64_t *ringData(int i) { return (int64_t*)(ring(i) + 1); }
+
+    QSharedMemory shm;
+    RingControl *ctl;
+};
+
+class SearchThread;
+struct Condition;
+
+/* Searches the units of a process search as worker i, with the results going
+ * to its ring. Returns the exit code for the command line.
+ */
+int runRingWorker(SearchThread& sthread, const QString& key, int i,
+        int type, int mc, const QVector<Condition>& cv);
+
+#endif // SEEDRING_H
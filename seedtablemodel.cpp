@@ -0,0 +1,278 @@
+#include "seedtablemodel.h"
+
+#include "cubiomes/finders.h"
+
+#include <algorithm>
+#include <inttypes.h>
+
+
+const int64_t SeedSet::EMPTY;
+
+// slot of the seed, or of the free slot where it would go
+int SeedSet::slot(int64_t s) const
+{
+    int mask = keys.size() - 1;
+    int i = home(s);
+    while (keys[i] != EMPTY && keys[i] != s)
+        i = (i + 1) & mask;
+    return i;
+}
+
+bool SeedSet::contains(int64_t s) const
+{
+    if (s == EMPTY)
+        return hasempty;
+    return cnt && keys[slot(s)] == s;
+}
+
+bool SeedSet::insert(int64_t s)
+{
+    if (s == EMPTY)
+    {
+        if (hasempty)
+            return false;
+        hasempty = true;
+        return true;
+    }
+    // kept at most half full, so the probe sequences stay short
+    if (2 * (cnt + 1) > keys.size())
+        rehash(bits ? bits + 1 : 10);
+    int i = slot(s);
+    if (keys[i] == s)
+        return false;
+    keys[i] = s;
+    cnt++;
+    return true;
+}
+
+void SeedSet::remove(int64_t s)
+{
+    if (s == EMPTY)
+    {
+        hasempty = false;
+        return;
+    }
+    if (!cnt)
+        return;
+    int mask = keys.size() - 1;
+    int i = slot(s);
+    if (keys[i] != s)
+        return;
+    // shift the following seeds of the probe sequence back into the gap
+    for (int j = (i + 1) & mask; keys[j] != EMPTY; j = (j + 1) & mask)
+    {
+        int h = home(keys[j]);
+        bool stays = i <= j ? (i < h && h <= j) : (i < h || h <= j);
+        if (!stays)
+        {
+            keys[i] = keys[j];
+            i = j;
+        }
+    }
+    keys[i] = EMPTY;
+    cnt--;
+}
+
+void SeedSet::clear()
+{
+    keys.clear();
+    bits = 0;
+    cnt = 0;
+    hasempty = false;
+}
+
+void SeedSet::reserve(int n)
+{
+    int b = 10;
+    while ((1 << b) < 2 * n)
+        b++;
+    if (b > bits)
+        rehash(b);
+}
+
+void SeedSet::rehash(int newbits)
+{
+    QVector<int64_t> old;
+    old.swap(keys);
+    bits = newbits;
+    keys.fill(EMPTY, 1 << bits);
+    int mask = keys.size() - 1;
+    for (int64_t s : old)
+    {
+        if (s == EMPTY)
+            continue;
+        int i = home(s);
+        while (keys[i] != EMPTY)
+            i = (i + 1) & mask;
+        keys[i] = s;
+    }
+}
+
+SeedTableModel::SeedTableModel(QObject *parent)
+    : QAbstractTableModel(parent)
+    , seeds(),seedset(),sortcol(-1),sortorder(Qt::AscendingOrder)
+{
+}
+
+int SeedTableModel::rowCount(const QModelIndex& parent) const
+{
+    return parent.isValid() ? 0 : seeds.size();
+}
+
+int SeedTableModel::columnCount(const QModelIndex& parent) const
+{
+    return parent.isValid() ? 0 : COL_MAX;
+}
+
+QVariant SeedTableModel::data(const QModelIndex& index, int role) const
+{
+    if (!index.isValid() || index.row() >= seeds.size())
+        return QVariant();
+
+    int64_t s = seeds[index.row()];
+    if (role == Qt::UserRole)
+        return QVariant::fromValue(s);
+    if (role != Qt::DisplayRole)
+        return QVariant();
+
+    if (index.column() == COL_HEX)
+    {
+        return QString::asprintf("%012llx|%04x",
+                (qulonglong)(s & MASK48), (uint)(s >> 48) & ((1 << 16) - 1));
+    }
+    return QString::asprintf("%" PRId64, s);
+}
+
+QVariant SeedTableModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+    if (role != Qt::DisplayRole)
+        return QVariant();
+    if (orientation == Qt::Vertical)
+        return section + 1;
+    if (section == COL_HEX)
+        return QString("Hex  (Low-48 | Top-16)");
+    if (section == COL_SEED)
+        return QString("Seed");
+    return QVariant();
+}
+
+bool SeedTableModel::lessThan(int64_t a, int64_t b) const
+{
+    bool lt;
+    if (sortcol == COL_HEX)
+    {
+        // same order as the hex strings
+        uint64_t ha = ((uint64_t)a << 16) | ((uint64_t)a >> 48);
+        uint64_t hb = ((uint64_t)b << 16) | ((uint64_t)b >> 48);
+        if (ha == hb)
+            return false;
+        lt = ha < hb;
+    }
+    else
+    {
+        if (a == b)
+            return false;
+        lt = a < b;
+    }
+    return sortorder == Qt::AscendingOrder ? lt : !lt;
+}
+
+// seeds of the persistent indexes (such as the selection) before a relayout
+QVector<int64_t> SeedTableModel::persistentSeeds() const
+{
+    QVector<int64_t> pseeds;
+    for (const QModelIndex& idx : persistentIndexList())
+        pseeds.push_back(seeds[idx.row()]);
+    return pseeds;
+}
+
+// moves the persistent indexes to the rows of their seeds in the sorted rows
+void SeedTableModel::updatePersistent(const QVector<int64_t>& pseeds)
+{
+    QModelIndexList from = persistentIndexList();
+    QModelIndexList to;
+    for (int i = 0; i < from.size(); i++)
+    {
+        auto it = std::lower_bound(seeds.begin(), seeds.end(), pseeds[i],
+            [this](int64_t a, int64_t b) { return lessThan(a, b); });
+        to.push_back(index(it - seeds.begin(), from[i].column()));
+    }
+    changePersistentIndexList(from, to);
+}
+
+void SeedTableModel::sort(int column, Qt::SortOrder order)
+{
+    sortcol = column;
+    sortorder = order;
+    if (sortcol < 0)
+        return;
+
+    emit layoutAboutToBeChanged();
+    QVector<int64_t> pseeds = persistentSeeds();
+    std::stable_sort(seeds.begin(), seeds.end(),
+        [this](int64_t a, int64_t b) { return lessThan(a, b); });
+    updatePersistent(pseeds);
+    emit layoutChanged();
+}
+
+int SeedTableModel::insertSeeds(const QVector<int64_t>& newseeds, bool countonly, int max)
+{
+    QVector<int64_t> add;
+    SeedSet batch;
+
+    for (int64_t s : newseeds)
+    {
+        if (seeds.size() + add.size() >= max)
+            break;
+        if (seedset.contains(s) || !batch.insert(s))
+            continue;
+        add.push_back(s);
+    }
+
+    if (countonly || add.empty())
+        return add.size();
+
+    int n = seeds.size();
+    auto cmp = [this](int64_t a, int64_t b) { return lessThan(a, b); };
+    if (sortcol >= 0)
+        std::sort(add.begin(), add.end(), cmp);
+
+    // the new rows are appended, so views learn about them as inserted rows
+    beginInsertRows(QModelIndex(), n, n + add.size() - 1);
+    seeds += add;
+    seedset.reserve(seeds.size());
+    for (int64_t s : add)
+        seedset.insert(s);
+    endInsertRows();
+
+    if (sortcol >= 0)
+    {
+        // then the sorted batch is merged into the sorted rows, which is
+        // linear in the number of rows, instead of inserting one row at a time
+        emit layoutAboutToBeChanged();
+        QVector<int64_t> pseeds = persistentSeeds();
+        std::inplace_merge(seeds.begin(), seeds.begin() + n, seeds.end(), cmp);
+        updatePersistent(pseeds);
+        emit layoutChanged();
+    }
+
+    return add.size();
+}
+
+void SeedTableModel::removeSeed(int row)
+{
+    if (row < 0 || row >= seeds.size())
+        return;
+    beginRemoveRows(QModelIndex(), row, row);
+    seedset.remove(seeds[row]);
+    seeds.remove(row);
+    endRemoveRows();
+}
+
+void SeedTableModel::clear()
+{
+    beginResetModel();
+    seeds.clear();
+    seedset.clear();
+    endResetModel();
+}
@@ -0,0 +1,82 @@
+#ifndef SEEDTABLEMODEL_H
+#define SEEDTABLEMODEL_H
+
+#include <QAbstractTableModel>
+#include <QVector>
+
+#include <stdint.h>
+
+
+/* Set of seeds as an open addressing hash table with linear probing, which
+ * keeps the seeds in one flat array instead of a node for each.
+ */
+class SeedSet
+{
+public:
+    SeedSet() : keys(),bits(),cnt(),hasempty() {}
+
+    bool contains(int64_t s) const;
+    /* Returns false if the seed is in the set already. */
+    bool insert(int64_t s);
+    void remove(int64_t s);
+    void clear();
+    void reserve(int n);
+    int size() const { return cnt + hasempty; }
+
+protected:
+    // marks a free slot, the seed with this value is kept as a flag
+    static const int64_t EMPTY = INT64_MIN;
+
+    int slot(int64_t s) const;
+    int home(int64_t s) const { return (int)(((uint64_t)s * 0x9e3779b97f4a7c15ULL) >> (64 - bits)); }
+    void rehash(int newbits);
+
+    QVector<int64_t> keys;      // 1 << bits slots
+    int bits;
+    int cnt;                    // seeds in the table, so keys exist if it is not 0
+    bool hasempty;              // whether EMPTY itself is in the set
+};
+
+/* Table of result seeds, with the hexadecimal (low-48 | top-16) seed in the
+ * first column and the decimal seed in the second. The seeds are kept as a
+ * plain array with a hash index for duplicates, and the cells are only
+ * formatted when a view asks for them.
+ */
+class SeedTableModel : public QAbstractTableModel
+{
+    Q_OBJECT
+
+public:
+    enum { COL_HEX, COL_SEED, COL_MAX };
+
+    explicit SeedTableModel(QObject *parent = nullptr);
+
+    int rowCount(const QModelIndex& parent = QModelIndex()) const override;
+    int columnCount(const QModelIndex& parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const override;
+    QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override;
+    void sort(int column, Qt::SortOrder order = Qt::AscendingOrder) override;
+
+    /* Adds the seeds that are not in the table yet, up to a total of 'max'
+     * rows. With 'countonly' the table is not changed.
+     * Returns the number of new seeds.
+     */
+    int insertSeeds(const QVector<int64_t>& seeds, bool countonly, int max);
+
+    int64_t seedAt(int row) const { return seeds[row]; }
+    const QVector<int64_t>& getSeeds() const { return seeds; }
+    void removeSeed(int row);
+    void clear();
+
+protected:
+    bool lessThan(int64_t a, int64_t b) const;
+    QVector<int64_t> persistentSeeds() const;
+    void updatePersistent(const QVector<int64_t>& pseeds);
+
+    QVector<int64_t> seeds;     // seeds in row order
+    SeedSet seedset;            // all seeds in the table
+    int sortcol;                // column the rows are sorted by, or -1
+    Qt::SortOrder sortorder;
+};
+
+#endif // SEEDTABLEMODEL_H
@@ -0,0 +1,271 @@
+#include "survivorcache.h"
+#include "checkpoint.h"
+
+#include <QDir>
+#include <QFileInfo>
+#include <QDataStream>
+#include <QByteArray>
+
+#include <inttypes.h>
+
+
+SurvivorCache::SurvivorCache()
+    : file(),lock(),key(),cover(-1),count(),datasiz(),last(),dirty()
+    , map(),mapsiz(),rpos(),rprev()
+{
+}
+
+uint64_t SurvivorCache::conditionKey(int mc, const Condition *cond, int n48)
+{
+    QByteArray ba;
+    QDataStream out(&ba, QIODevice::WriteOnly);
+    out.setByteOrder(QDataStream::BigEndian);
+    out << (qint32) CACHE48_VERSION << (qint32) mc << (qint32) n48;
+    for (int i = 0; i < n48; i++)
+        writeCondition(out, cond[i]);
+
+    // FNV-1a
+    uint64_t h = 0xcbf29ce484222325ULL;
+    const uchar *p = (const uchar*) ba.constData();
+    for (int i = 0; i < ba.size(); i++)
+    {
+        h ^= p[i];
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+bool SurvivorCache::open(const QString& dir, int mc, const Condition *cond, int n48)
+{
+    close();
+    if (n48 <= 0 || dir.isEmpty() || !QDir().mkpath(dir))
+        return false;
+
+    key = conditionKey(mc, cond, n48);
+    QString path = QDir(dir).filePath(QString::asprintf("%016" PRIx64 ".c48", key));
+
+    // make room for this cache among the others, before it grows
+    evict(dir, CACHE48_MAXTOTAL - CACHE48_MAXSIZE, path);
+
+    // the lock is held until the cache is closed, and is only stale once
+    // the process that holds it has died
+    lock = new QLockFile(path + ".lock");
+    lock->setStaleLockTime(0);
+    if (!lock->tryLock(0))
+    {
+        delete lock;
+        lock = NULL;
+    }
+
+    file.setFileName(path);
+    if (!file.open(lock ? QIODevice::ReadWrite : QIODevice::ReadOnly))
+    {
+        close();
+        return false;
+    }
+
+    bool valid = readHeader();
+    if (!valid)
+        cover = -1, count = 0, datasiz = 0;
+
+    if (lock)
+    {
+        // survivors written after the last update of the header are dropped,
+        // which no reader has mapped, as they are not covered by the header
+        if (!file.resize(CACHE48_HEADSIZ + datasiz) || (!valid && !writeHeader()))
+        {
+            close();
+            return false;
+        }
+    }
+
+    if (datasiz > 0)
+    {
+        mapsiz = datasiz;
+        map = file.map(CACHE48_HEADSIZ, mapsiz);
+        if (!map)
+        {
+            close();
+            return false;
+        }
+    }
+
+    // check the survivors and find the last one, which later deltas continue from
+    int64_t s, n = 0;
+    last = 0;
+    rewind();
+    while (next(&s))
+    {
+        last = s;
+        n++;
+    }
+    if (n != count || rpos != mapsiz)
+    {
+        file.unmap(map);
+        map = NULL;
+        mapsiz = 0;
+        cover = -1, count = 0, datasiz = 0, last = 0;
+        // other processes may have mapped the bad survivors, so the file is
+        // replaced instead of truncated
+        if (lock && !recreate())
+        {
+            close();
+            return false;
+        }
+    }
+
+    rewind();
+    return !lock || file.seek(CACHE48_HEADSIZ + datasiz);
+}
+
+void SurvivorCache::close()
+{
+    if (file.isOpen())
+    {
+        flush();
+        if (map)
+            file.unmap(map);
+        file.close();
+    }
+    map = NULL;
+    mapsiz = 0;
+    delete lock;
+    lock = NULL;
+    cover = -1, count = 0, datasiz = 0, last = 0;
+}
+
+int64_t SurvivorCache::evict(const QString& dir, int64_t maxtotal, const QString& keep)
+{
+    QFileInfoList files = QDir(dir).entryInfoList(
+            QStringList() << "*.c48", QDir::Files, QDir::Time | QDir::Reversed);
+    int64_t total = 0;
+    for (const QFileInfo& fi : files)
+        total += fi.size();
+
+    // the oldest are listed first
+    for (const QFileInfo& fi : files)
+    {
+        if (total <= maxtotal)
+            break;
+        QString path = fi.filePath();
+        if (path == keep)
+            continue;
+        QLockFile lock(path + ".lock");
+        lock.setStaleLockTime(0);
+        if (!lock.tryLock(0))
+            continue; // being extended
+        // readers that have the file mapped keep their copy until they close it
+        if (QFile::remove(path))
+            total -= fi.size();
+    }
+    return total;
+}
+
+void SurvivorCache::rewind()
+{
+    rpos = 0;
+    rprev = 0;
+}
+
+bool SurvivorCache::next(int64_t *s48)
+{
+    uint64_t d = 0;
+    int shift = 0;
+    uchar b;
+    do
+    {
+        if (rpos >= mapsiz || shift > 63)
+            return false;
+        b = map[rpos++];
+        d |= (uint64_t)(b & 0x7f) << shift;
+        shift += 7;
+    }
+    while (b & 0x80);
+    rprev += d;
+    *s48 = rprev;
+    return true;
+}
+
+bool SurvivorCache::append(const QVector<int64_t>& bases, int64_t start, int64_t end)
+{
+    if (!file.isOpen() || !lock || start != cover + 1)
+        return false;
+
+    QByteArray ba;
+    int64_t prev = last;
+    for (int64_t s : bases)
+    {
+        uint64_t d = s - prev;
+        prev = s;
+        while (d >= 0x80)
+        {
+            ba.append((char)(d | 0x80));
+            d >>= 7;
+        }
+        ba.append((char)d);
+    }
+    if (datasiz + ba.size() > CACHE48_MAXSIZE)
+        return false;
+    if (file.write(ba) != ba.size())
+        return false;
+
+    datasiz += ba.size();
+    count += bases.size();
+    cover = end;
+    last = prev;
+    dirty = true;
+    return true;
+}
+
+bool SurvivorCache::flush()
+{
+    if (!dirty)
+        return true;
+    dirty = false;
+    // the survivors have to be written before the header that includes them
+    return file.flush() && writeHeader() && file.seek(CACHE48_HEADSIZ + datasiz);
+}
+
+bool SurvivorCache::readHeader()
+{
+    if (file.size() < CACHE48_HEADSIZ || !file.seek(0))
+        return false;
+    QDataStream in(&file);
+    in.setByteOrder(QDataStream::BigEndian);
+    quint32 magic, version;
+    quint64 k;
+    qint64 c, n, d;
+    in >> magic >> version >> k >> c >> n >> d;
+    bool valid = in.status() == QDataStream::Ok && magic == CACHE48_MAGIC &&
+            version == CACHE48_VERSION && k == key && c >= -1 && c <= MASK48 &&
+            n >= 0 && d >= 0 && CACHE48_HEADSIZ + d <= file.size();
+    if (valid)
+    {
+        cover = c;
+        count = n;
+        datasiz = d;
+    }
+    return valid;
+}
+
+// replaces the file with an empty cache, while the lock is held
+bool SurvivorCache::recreate()
+{
+    QString path = file.fileName();
+    file.close();
+    if (!QFile::remove(path))
+        return false;
+    file.setFileName(path);
+    return file.open(QIODevice::ReadWrite) && writeHeader();
+}
+
+bool SurvivorCache::writeHeader()
+{
+    if (!file.seek(0))
+        return false;
+    QDataStream out(&file);
+    out.setByteOrder(QDataStream::BigEndian);
+    out << (quint32) CACHE48_MAGIC << (quint32) CACHE48_VERSION << (quint64) key;
+    out << (qint64) cover << (qint64) count << (qint64) datasiz;
+    return out.status() == QDataStream::Ok && file.flush();
+}
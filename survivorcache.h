@@ -0,0 +1,97 @@
+#ifndef SURVIVORCACHE_H
+#define SURVIVORCACHE_H
+
+#include "search.h"
+
+#include <QFile>
+#include <QLockFile>
+#include <QString>
+#include <QVector>
+
+#define CACHE48_MAGIC       0x43563438 // "CV48"
+#define CACHE48_VERSION     1
+#define CACHE48_HEADSIZ     40
+#define CACHE48_MAXSIZE     ((int64_t)1 << 30)
+#define CACHE48_MAXTOTAL    ((int64_t)4 << 30)
+
+/* On-disk cache of the 48-bit seeds that pass the 48-bit conditions of a
+ * search. Searches that share these conditions, such as when only the biome
+ * conditions have changed, can stream the survivors instead of scanning the
+ * 48-bit seed space again.
+ *
+ * The file is named after a hash of the MC version and the 48-bit conditions,
+ * and holds the survivors of the range [0, covered] as variable length deltas.
+ * It grows as searches continue beyond the covered range.
+ *
+ * Only one process at a time extends the cache, by holding a lock file next to
+ * it. Other processes read the range that was covered when they opened it.
+ * The survivors are only ever appended, so the part that a reader has mapped
+ * does not change, and a cache that has to be discarded is replaced by a new
+ * file rather than truncated.
+ *
+ * The caches of a directory are kept below CACHE48_MAXTOTAL together, by
+ * removing the caches that were least recently extended when another is opened.
+ */
+class SurvivorCache
+{
+public:
+    SurvivorCache();
+    ~SurvivorCache() { close(); }
+
+    /* Opens (or creates) the cache for the 48-bit conditions cond[0..n48) in
+     * the given directory. Returns false if the cache is not available.
+     */
+    bool open(const QString& dir, int mc, const Condition *cond, int n48);
+    void close();
+
+    bool isOpen() const { return file.isOpen(); }
+    /* Whether this process holds the lock to extend the cache. */
+    bool isWritable() const { return lock != NULL; }
+    /* The last 48-bit seed the cache covers, or -1 if it is empty. */
+    int64_t covered() const { return cover; }
+
+    /* Restarts the reading of the cached survivors. */
+    void rewind();
+    /* Reads the next cached survivor. Returns false at the end. */
+    bool next(int64_t *s48);
+
+    /* Extends the cache with the survivors of the range [start, end].
+     * Returns false if the cache cannot be extended, because the range does
+     * not continue from the covered range, the cache is full, or another
+     * process is extending it.
+     */
+    bool append(const QVector<int64_t>& bases, int64_t start, int64_t end);
+    /* Makes the appended survivors part of the cache on disk. */
+    bool flush();
+
+    static uint64_t conditionKey(int mc, const Condition *cond, int n48);
+
+    /* Removes the caches of a directory, oldest first, until they take up
+     * at most 'maxtotal' bytes. Caches that are open for writing, and the
+     * cache at 'keep', are kept. Returns the number of bytes that remain.
+     */
+    static int64_t evict(const QString& dir, int64_t maxtotal, const QString& keep = QString());
+    /* Removes all caches of a directory that are not open for writing. */
+    static void clear(const QString& dir) { evict(dir, 0); }
+
+protected:
+    bool readHeader();
+    bool writeHeader();
+    bool recreate();
+
+    QFile file;
+    QLockFile *lock;    // held while this process extends the cache
+    uint64_t key;
+    int64_t cover;      // last 48-bit seed covered
+    int64_t count;      // number of survivors
+    int64_t datasiz;    // bytes of encoded survivors
+    int64_t last;       // last survivor, which the next delta is relative to
+    bool dirty;
+
+    uchar *map;         // encoded survivors when the cache was opened
+    int64_t mapsiz;
+    int64_t rpos;       // read position in the map
+    int64_t rprev;      // last survivor that was read
+};
+
+#endif // SURVIVORCACHE_H
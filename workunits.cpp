@@ -0,0 +1,268 @@
+#include "workunits.h"
+#include "searchthread.h"
+
+#include <QCoreApplication>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QSysInfo>
+#include <QSet>
+#include <QMap>
+#include <QThread>
+
+#include <algorithm>
+
+#include <inttypes.h>
+#include <stdio.h>
+
+
+static QString unitName(int64_t start, int64_t end)
+{
+    return QString::asprintf("%012" PRIx64 "-%012" PRIx64, start, end);
+}
+
+// parses the unit at the start of a file name
+static bool parseUnit(const QString& name, int64_t *start, int64_t *end)
+{
+    unsigned long long a, b;
+    if (sscanf(name.toLatin1().data(), "%12llx-%12llx", &a, &b) != 2 || a > b)
+        return false;
+    *start = a;
+    *end = b;
+    return true;
+}
+
+static QStringList listFiles(const QDir& dir, const QString& sub)
+{
+    return QDir(dir.filePath(sub)).entryList(QDir::Files, QDir::Name);
+}
+
+/* Writes the unit list and the files of a new job.
+ */
+static bool createJob(const QDir& dir, const Checkpoint& job, int units)
+{
+    if (!dir.mkpath(UNIT_TODO) || !dir.mkpath(UNIT_LEASE) || !dir.mkpath(UNIT_DONE))
+        return false;
+
+    int64_t range = job.end - job.progress + 1;
+    if (units < 1)
+        units = 1;
+    int64_t unitsiz = (range + units - 1) / units;
+
+    QFile list(dir.filePath(UNIT_LIST));
+    if (!list.open(QIODevice::WriteOnly))
+        return false;
+    for (int64_t s = job.progress; s <= job.end; s += unitsiz)
+    {
+        int64_t e = std::min(s + unitsiz - 1, job.end);
+        QString name = unitName(s, e);
+        QFile todo(dir.filePath(UNIT_TODO "/" + name));
+        if (!todo.open(QIODevice::WriteOnly))
+            return false;
+        list.write((name + "\n").toLatin1());
+    }
+    list.close();
+
+    // the job file is written last, as workers and restarts look for it
+    return saveCheckpoint(dir.filePath(UNIT_JOB), job);
+}
+
+int runCoordinator(const QString& path, const Checkpoint& newjob, int units, int leasesec)
+{
+    QDir dir(path);
+    Checkpoint job;
+
+    if (QFile::exists(dir.filePath(UNIT_JOB)))
+    {
+        if (!loadCheckpoint(dir.filePath(UNIT_JOB), &job))
+        {
+            fprintf(stderr, "Failed to read job: %s\n", path.toLocal8Bit().data());
+            return 1;
+        }
+        fprintf(stderr, "Continuing job in: %s\n", path.toLocal8Bit().data());
+    }
+    else
+    {
+        job = newjob;
+        if (job.condvec.empty() || !QDir().mkpath(path) || !createJob(dir, job, units))
+        {
+            fprintf(stderr, "Failed to create job in: %s\n", path.toLocal8Bit().data());
+            return 1;
+        }
+    }
+
+    // units that are not merged yet, by their start
+    QMap<int64_t, int64_t> pending;
+    QFile list(dir.filePath(UNIT_LIST));
+    if (!list.open(QIODevice::ReadOnly))
+    {
+        fprintf(stderr, "Failed to read unit list.\n");
+        return 1;
+    }
+    while (!list.atEnd())
+    {
+        int64_t s, e;
+        if (parseUnit(QString::fromLatin1(list.readLine()), &s, &e))
+            pending[s] = e;
+    }
+    list.close();
+    int total = pending.size();
+
+    // finished units may already be merged, so the results are deduplicated
+    QSet<int64_t> seedset;
+    for (int64_t s : job.seeds)
+        seedset.insert(s);
+
+    while (!pending.empty())
+    {
+        bool changed = false;
+
+        for (const QString& name : listFiles(dir, UNIT_DONE))
+        {
+            int64_t s, e;
+            if (!parseUnit(name, &s, &e) || !pending.contains(s))
+                continue;
+            Checkpoint res;
+            if (!loadCheckpoint(dir.filePath(UNIT_DONE "/" + name), &res))
+                continue;
+            for (int64_t seed : res.seeds)
+            {
+                if (seedset.contains(seed))
+                    continue;
+                seedset.insert(seed);
+                job.seeds.push_back(seed);
+            }
+            pending.remove(s);
+            // the unit may have been returned after its lease expired
+            QFile::remove(dir.filePath(UNIT_TODO "/" + name));
+            changed = true;
+        }
+
+        qint64 now = QDateTime::currentMSecsSinceEpoch();
+        for (const QString& name : listFiles(dir, UNIT_LEASE))
+        {
+            int64_t s, e;
+            QString lease = dir.filePath(UNIT_LEASE "/" + name);
+            if (!parseUnit(name, &s, &e))
+                continue;
+            if (!pending.contains(s))
+            {
+                QFile::remove(lease);
+                continue;
+            }
+            qint64 t = QFileInfo(lease).lastModified().toMSecsSinceEpoch();
+            if (now - t > (qint64)leasesec * 1000)
+            {
+                QString unit = unitName(s, e);
+                if (QFile::rename(lease, dir.filePath(UNIT_TODO "/" + unit)))
+                    fprintf(stderr, "Lease expired: %s\n", name.toLocal8Bit().data());
+            }
+        }
+
+        if (changed)
+        {
+            job.progress = pending.empty() ? job.end + 1 : pending.firstKey();
+            if (!saveCheckpoint(dir.filePath(UNIT_JOB), job))
+                fprintf(stderr, "Failed to write job checkpoint.\n");
+            fprintf(stderr, "Units done: %d / %d, seeds: %d\n",
+                    total - pending.size(), total, job.seeds.size());
+        }
+
+        if (!pending.empty())
+            QThread::sleep(UNIT_POLL_SEC);
+    }
+
+    fprintf(stderr, "Job finished: %s\n", path.toLocal8Bit().data());
+    return 0;
+}
+
+// touches a lease, which fails if the coordinator has returned it already
+static bool renewLease(const QString& lease, int64_t progress)
+{
+    QFile file(lease);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::ExistingOnly))
+        return false;
+    file.write(QString::asprintf("%" PRId64 "\n", progress).toLatin1());
+    return true;
+}
+
+int runWorker(const QString& path, int threads, const QString& cachedir)
+{
+    QDir dir(path);
+    Checkpoint job;
+    if (!loadCheckpoint(dir.filePath(UNIT_JOB), &job))
+    {
+        fprintf(stderr, "Failed to read job: %s\n", path.toLocal8Bit().data());
+        return 1;
+    }
+
+    QString worker = QSysInfo::machineHostName() + "-" +
+            QString::number(QCoreApplication::applicationPid());
+
+    SearchThread sthread(NULL);
+    sthread.setThreads(threads);
+    sthread.setCacheDir(cachedir);
+
+    while (true)
+    {
+        QStringList todo = listFiles(dir, UNIT_TODO);
+        if (todo.empty())
+        {
+            // leases of other workers may still expire and be returned
+            if (listFiles(dir, UNIT_LEASE).empty())
+                break;
+            QThread::sleep(UNIT_POLL_SEC);
+            continue;
+        }
+
+        QString unit, lease;
+        for (const QString& name : todo)
+        {
+            lease = dir.filePath(UNIT_LEASE "/" + name + "." + worker);
+            if (QFile::rename(dir.filePath(UNIT_TODO "/" + name), lease))
+            {
+                unit = name;
+                break;
+            }
+        }
+        int64_t start, end;
+        if (unit.isEmpty() || !parseUnit(unit, &start, &end))
+            continue;
+        // the rename keeps the time of the todo file, which would let the
+        // lease expire right away
+        if (!renewLease(lease, start))
+            continue;
+
+        fprintf(stderr, "Unit %s\n", unit.toLocal8Bit().data());
+        if (!sthread.set(job.searchtype, start, end, job.mc, job.condvec))
+            return 1;
+
+        Checkpoint res = job;
+        res.seeds.clear();
+        sthread.start();
+        int beat = 0;
+        while (!sthread.wait(1000))
+        {
+            sthread.takeResults(res.seeds);
+            if (++beat < UNIT_BEAT_SEC)
+                continue;
+            beat = 0;
+            // renew the lease, unless it has been returned in the meantime
+            renewLease(lease, sthread.progress());
+        }
+        sthread.takeResults(res.seeds);
+
+        res.progress = end + 1;
+        res.end = end;
+        if (!saveCheckpoint(dir.filePath(UNIT_DONE "/" + unit), res))
+        {
+            fprintf(stderr, "Failed to write results of unit %s\n", unit.toLocal8Bit().data());
+            return 1;
+        }
+        QFile::remove(lease);
+    }
+
+    fprintf(stderr, "No work units left.\n");
+    return 0;
+}
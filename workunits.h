@@ -0,0 +1,43 @@
+#ifndef WORKUNITS_H
+#define WORKUNITS_H
+
+#include "checkpoint.h"
+
+#include <QString>
+
+#define UNIT_JOB        "job.cvcp"
+#define UNIT_LIST       "units.txt"
+#define UNIT_TODO       "todo"
+#define UNIT_LEASE      "lease"
+#define UNIT_DONE       "done"
+#define UNIT_POLL_SEC   2
+#define UNIT_BEAT_SEC   30
+
+/* A search can be shared by several processes or machines through a job
+ * directory, on a drive that they all have access to:
+ *
+ *  job.cvcp    the conditions and the merged results, which the GUI can open
+ *  units.txt   names of all work units, each a range of 48-bit seeds
+ *  todo/       an empty file for each unit that is available
+ *  lease/      units that are taken, as "<unit>.<worker>", which the worker
+ *              rewrites as a heartbeat
+ *  done/       a checkpoint with the results of each finished unit
+ *
+ * A worker takes a unit by renaming it from todo/ to lease/, which only one
+ * worker can do. The coordinator merges the finished units into the job and
+ * returns leases that have not been renewed in time to todo/.
+ */
+
+/* Creates the job directory for the range [job.progress, job.end], split into
+ * 'units' work units, or continues the job of an existing directory. Then
+ * merges the results until all units are done.
+ * Returns the exit code for the command line.
+ */
+int runCoordinator(const QString& path, const Checkpoint& job, int units, int leasesec);
+
+/* Takes work units from the job directory and searches them until there are
+ * none left. Returns the exit code for the command line.
+ */
+int runWorker(const QString& path, int threads, const QString& cachedir);
+
+#endif // WORKUNITS_H